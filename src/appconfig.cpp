@@ -7,6 +7,7 @@
 #include <QJsonArray>
 #include <QDateTime>
 #include <QTime>
+#include <QFile>
 #include <QFileInfo>
 #include <QDir>
 
@@ -48,36 +49,54 @@ void SetJSONBool(bool &value, QJsonObject jsonDoc, const char *key) {
   }
 }
 
-Config loadConfiguration(const std::string &configFilePath, const Config &currentConfig) {
-  if(configFilePath.empty())
+// appends the windows of a "times" array, returns whether there was one
+bool ParseJSONTimeWindows(QVector<DisplayTimeWindow> &timeWindows, QJsonObject jsonDoc) {
+  if(!jsonDoc.contains("times") || !jsonDoc["times"].isArray())
   {
-    return currentConfig;
+    return false;
   }
-
-  QString jsonFile(configFilePath.c_str());
-  QDir directory;
-  if(!directory.exists(jsonFile))
+  QJsonArray jsonArray = jsonDoc["times"].toArray();
+  foreach (const QJsonValue & value, jsonArray) 
   {
-    return currentConfig; // nothing to load
+    QJsonObject obj = value.toObject();
+    if(obj.contains("start") || obj.contains("end"))
+    {
+        DisplayTimeWindow window;
+        if(obj.contains("start"))
+        {
+            window.startDisplay = QTime::fromString(obj["start"].toString());
+        }
+        if(obj.contains("end"))
+        {
+            window.endDisplay = QTime::fromString(obj["end"].toString());
+        }
+        timeWindows.append(window);
+    }
   }
+  return true;
+}
 
-  Config userConfig = currentConfig;
-
-  Log( "Found options file: ", jsonFile.toStdString() );
-
-  QString val;
-  QFile file;
-  file.setFileName(jsonFile);
-  file.open(QIODevice::ReadOnly | QIODevice::Text);
-  val = file.readAll();
-  file.close();
-  if (val.length() <= 1 )
+bool readJSONFile(const QString &jsonFile, QJsonObject &jsonDoc) {
+  QFile file(jsonFile);
+  if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
   {
     Log( "Failed to read options file: ", jsonFile.toStdString() );
-    return currentConfig; // nothing to load
+    return false;
   }
-  QJsonDocument d = QJsonDocument::fromJson(val.toUtf8());
-  QJsonObject jsonDoc = d.object();
+  QJsonParseError error;
+  QJsonDocument d = QJsonDocument::fromJson(file.readAll(), &error);
+  if(!d.isObject())
+  {
+    Log( "Failed to parse options file: ", jsonFile.toStdString(), ": ", error.errorString().toStdString() );
+    return false;
+  }
+  jsonDoc = d.object();
+  return true;
+}
+
+Config applyConfiguration(const QJsonObject &jsonDoc, const Config &currentConfig) {
+  Config userConfig = currentConfig;
+
   SetJSONBool(userConfig.baseDisplayOptions.fitAspectAxisToWindow, jsonDoc, "stretch");
 
   std::string aspectString = ParseJSONString(jsonDoc, "aspect");
@@ -100,42 +119,13 @@ Config loadConfiguration(const std::string &configFilePath, const Config &curren
     userConfig.blurRadius = (int)jsonDoc["blur"].toDouble();
   }
 
-  if(jsonDoc.contains("times") && jsonDoc["times"].isArray())
-  {
-      QJsonArray jsonArray = jsonDoc["times"].toArray();
-      foreach (const QJsonValue & value, jsonArray) 
-      {
-        QJsonObject obj = value.toObject();
-        if(obj.contains("start") || obj.contains("end"))
-        {
-            DisplayTimeWindow window;
-            if(obj.contains("start"))
-            {
-                window.startDisplay = QTime::fromString(obj["start"].toString());
-            }
-            if(obj.contains("end"))
-            {
-                window.endDisplay = QTime::fromString(obj["end"].toString());
-            }
-            userConfig.baseDisplayOptions.timeWindows.append(window);
-        }
-     }
-  }
+  ParseJSONTimeWindows(userConfig.baseDisplayOptions.timeWindows, jsonDoc);
 
   userConfig.loadTime = QDateTime::currentDateTime();
   return userConfig;
 }
 
 
-AppConfig loadConfiguration(const std::string &configFilePath, const AppConfig &currentConfig) {
-  AppConfig userConfig = currentConfig;
-  // make sure to only update the base members, preserve the ones from the copy above
-  (Config &)userConfig = loadConfiguration(configFilePath, (const Config &)userConfig);
-
-  return userConfig;
-}
-
-
 QString getAppConfigFilePath(const std::string &configPath) {
   std::string userConfigFolder = "~/.config/slide/";
   std::string systemConfigFolder = "/etc/slide";
@@ -197,37 +187,35 @@ QVector<PathEntry> parsePathEntry(QJsonObject &jsonMainDoc, bool baseRecursive,
       if(!imageListString.empty()) {
         entry.imageList = imageListString;
       }
+      std::string imageListFileString = ParseJSONString(schedulerJson, "imageListFile");
+      if(!imageListFileString.empty()) {
+        entry.imageListFile = imageListFileString;
+      }
 
       SetJSONBool(entry.exclusive, schedulerJson, "exclusive");
 
-      if(schedulerJson.contains("times") && schedulerJson["times"].isArray())
-      {
-          QJsonArray jsonTimesArray = schedulerJson["times"].toArray();
-          foreach (const QJsonValue & timesValue, jsonTimesArray) 
-          {
-            QJsonObject timesJson = timesValue.toObject();
-            if(timesJson.contains("start") || timesJson.contains("end"))
-            {
-                DisplayTimeWindow window;
-                if(timesJson.contains("start"))
-                {
-                    window.startDisplay = QTime::fromString(timesJson["start"].toString());
-                }
-                if(timesJson.contains("end"))
-                {
-                    window.endDisplay = QTime::fromString(timesJson["end"].toString());
-                }
-                entry.baseDisplayOptions.timeWindows.append(window);
-            }
-        }
-      }
+      ParseJSONTimeWindows(entry.baseDisplayOptions.timeWindows, schedulerJson);
       pathEntries.append(entry);
     }
   }
   return pathEntries;
 }
 
-AppConfig loadAppConfiguration(const AppConfig &commandLineConfig) {
+std::string PathEntry::stateKey() const {
+  QString key = QString::fromStdString(path + "|" + imageList + "|" + imageListFile);
+  key += QString("|%1|%2").arg(recursive ? "r" : "").arg((int)baseDisplayOptions.onlyAspect);
+  for (const DisplayTimeWindow &window : baseDisplayOptions.timeWindows)
+  {
+    key += "|" + window.startDisplay.toString("hh:mm:ss") + "-" + window.endDisplay.toString("hh:mm:ss");
+  }
+  return key.toStdString();
+}
+
+AppConfig loadAppConfiguration(const AppConfig &commandLineConfig, bool *loaded) {
+  if(loaded != nullptr)
+  {
+    *loaded = false;
+  }
   if(commandLineConfig.configPath.empty())
   {
     return commandLineConfig;
@@ -240,16 +228,20 @@ AppConfig loadAppConfiguration(const AppConfig &commandLineConfig) {
     return commandLineConfig;
   }
 
-  AppConfig loadedConfig = loadConfiguration(jsonFile.toStdString(), commandLineConfig);
+  Log( "Found options file: ", jsonFile.toStdString() );
+  QJsonObject jsonDoc;
+  if(!readJSONFile(jsonFile, jsonDoc))
+  {
+    return commandLineConfig;
+  }
+  if(loaded != nullptr)
+  {
+    *loaded = true;
+  }
 
-  QString val;
-  QFile file;
-  file.setFileName(jsonFile);
-  file.open(QIODevice::ReadOnly | QIODevice::Text);
-  val = file.readAll();
-  file.close();
-  QJsonDocument d = QJsonDocument::fromJson(val.toUtf8());
-  QJsonObject jsonDoc = d.object();
+  AppConfig loadedConfig = commandLineConfig;
+  // make sure to only update the base members, preserve the app level ones from the copy above
+  (Config &)loadedConfig = applyConfiguration(jsonDoc, (const Config &)commandLineConfig);
 
   bool baseRecursive = false, baseShuffle = false, baseSorted = false;
   SetJSONBool(baseRecursive, jsonDoc, "recursive");
@@ -257,6 +249,53 @@ AppConfig loadAppConfiguration(const AppConfig &commandLineConfig) {
   SetJSONBool(baseSorted, jsonDoc, "sorted");
   SetJSONBool(loadedConfig.debugMode, jsonDoc, "debug");
 
+  if(jsonDoc.contains("prefetch") && jsonDoc["prefetch"].isDouble())
+  {
+    loadedConfig.prefetchDepth = (unsigned int)jsonDoc["prefetch"].toDouble();
+  }
+  if(jsonDoc.contains("prefetchMemoryMB") && jsonDoc["prefetchMemoryMB"].isDouble())
+  {
+    loadedConfig.prefetchMemoryMB = (unsigned int)jsonDoc["prefetchMemoryMB"].toDouble();
+  }
+
+  if(jsonDoc.contains("frameCacheMB") && jsonDoc["frameCacheMB"].isDouble())
+  {
+    loadedConfig.frameCacheMB = (unsigned int)jsonDoc["frameCacheMB"].toDouble();
+  }
+  if(jsonDoc.contains("frameCacheMemoryMB") && jsonDoc["frameCacheMemoryMB"].isDouble())
+  {
+    loadedConfig.frameCacheMemoryMB = (unsigned int)jsonDoc["frameCacheMemoryMB"].toDouble();
+  }
+
+  if(jsonDoc.contains("blurDownscale") && jsonDoc["blurDownscale"].isDouble())
+  {
+    loadedConfig.blurDownscale = (unsigned int)jsonDoc["blurDownscale"].toDouble();
+  }
+
+  if(jsonDoc.contains("transitionFps") && jsonDoc["transitionFps"].isDouble())
+  {
+    loadedConfig.transitionFps = (unsigned int)jsonDoc["transitionFps"].toDouble();
+  }
+
+  if(jsonDoc.contains("decodeMaxMB") && jsonDoc["decodeMaxMB"].isDouble())
+  {
+    loadedConfig.decodeMaxMB = (unsigned int)jsonDoc["decodeMaxMB"].toDouble();
+  }
+  if(jsonDoc.contains("decodeMaxMegapixels") && jsonDoc["decodeMaxMegapixels"].isDouble())
+  {
+    loadedConfig.decodeMaxMegapixels = (unsigned int)jsonDoc["decodeMaxMegapixels"].toDouble();
+  }
+
+  std::string metricsFileString = ParseJSONString(jsonDoc, "metricsFile");
+  if(!metricsFileString.empty())
+  {
+    loadedConfig.metricsFile = metricsFileString;
+  }
+  if(jsonDoc.contains("metricsIntervalSeconds") && jsonDoc["metricsIntervalSeconds"].isDouble())
+  {
+    loadedConfig.metricsIntervalSeconds = (unsigned int)jsonDoc["metricsIntervalSeconds"].toDouble();
+  }
+
   std::string overlayString = ParseJSONString(jsonDoc, "overlay");
   if(!overlayString.empty())
   {
@@ -280,22 +319,77 @@ AppConfig loadAppConfiguration(const AppConfig &commandLineConfig) {
     {
       entry.imageList = imageListString;
     }
+    std::string imageListFileString = ParseJSONString(jsonDoc, "imageListFile");
+    if(!imageListFileString.empty())
+    {
+      entry.imageListFile = imageListFileString;
+    }
     loadedConfig.paths.append(entry);
   }
   loadedConfig.configPath = commandLineConfig.configPath;
   return loadedConfig;
 }
 
-Config getConfigurationForFolder(const std::string &folderPath, const Config &currentConfig) {
-  if(folderPath.empty())
+void FolderOptions::inheritFrom(const FolderOptions &parent)
+{
+  if(!hasStretch)
   {
-    return currentConfig;
+    hasStretch = parent.hasStretch;
+    stretch = parent.stretch;
   }
-  QDir directory(folderPath.c_str());
-  QString jsonFile = directory.filePath(QString("options.json"));
-  if(directory.exists(jsonFile))
+  if(!hasAspect)
+  {
+    hasAspect = parent.hasAspect;
+    aspect = parent.aspect;
+  }
+  if(!hasTimes)
+  {
+    hasTimes = parent.hasTimes;
+    timeWindows = parent.timeWindows;
+  }
+}
+
+void FolderOptions::applyTo(ImageDisplayOptions &options) const
+{
+  if(hasStretch)
+  {
+    options.fitAspectAxisToWindow = stretch;
+  }
+  if(hasAspect)
+  {
+    options.onlyAspect = aspect;
+    options.folderAspect = true;
+  }
+  options.timeWindows += timeWindows;
+}
+
+bool loadFolderOptions(const std::string &jsonPath, FolderOptions &options) {
+  options = FolderOptions();
+  QFile file(QString::fromStdString(jsonPath));
+  if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+  {
+    return false;
+  }
+  Log( "Found options file: ", jsonPath );
+  QJsonParseError error;
+  QJsonDocument d = QJsonDocument::fromJson(file.readAll(), &error);
+  if(d.isNull())
+  {
+    Log( "Failed to parse options file: ", jsonPath, ": ", error.errorString().toStdString() );
+    return false;
+  }
+  QJsonObject jsonDoc = d.object();
+  if(jsonDoc.contains("stretch") && jsonDoc["stretch"].isBool())
+  {
+    options.hasStretch = true;
+    options.stretch = jsonDoc["stretch"].toBool();
+  }
+  std::string aspectString = ParseJSONString(jsonDoc, "aspect");
+  if(!aspectString.empty())
   {
-      return loadConfiguration(jsonFile.toStdString(), currentConfig );
+    options.hasAspect = true;
+    options.aspect = parseAspectFromString(aspectString[0]);
   }
-  return currentConfig;
-}
\ No newline at end of file
+  options.hasTimes = ParseJSONTimeWindows(options.timeWindows, jsonDoc);
+  return true;
+}
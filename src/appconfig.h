@@ -4,6 +4,7 @@
 #include <QDateTime>
 #include "imagestructs.h"
 #include <QVector>
+#include <QSize>
 
 // configuration options that apply to an image/folder of images
 struct Config {
@@ -19,6 +20,7 @@ struct Config {
 struct PathEntry {
   std::string path = "";
   std::string imageList = "";
+  std::string imageListFile = ""; // newline delimited list of images, one per line
   bool exclusive = false; // only use this entry when it is valid, skip others
 
   bool recursive = false;
@@ -26,6 +28,15 @@ struct PathEntry {
   bool sorted = false;
   ImageDisplayOptions baseDisplayOptions;
 
+  // identifies the images this entry shows, so state kept per entry (a shuffle position)
+  // isn't shared by entries over the same folder with different filters
+  std::string stateKey() const;
+  // whether both entries show the same images in the same order, so one's selector can serve the other
+  bool sameSource(const PathEntry &b) const
+  {
+    return b.path == path && b.imageList == imageList && b.imageListFile == imageListFile &&
+           b.recursive == recursive && b.shuffle == shuffle && b.sorted == sorted;
+  }
   bool operator==(const PathEntry &b) const
   {
     return !operator!=(b);
@@ -38,7 +49,7 @@ struct PathEntry {
       return true;
     if(b.baseDisplayOptions.fitAspectAxisToWindow != baseDisplayOptions.fitAspectAxisToWindow)
       return true;
-    if (b.path != path || b.imageList != imageList)
+    if (b.path != path || b.imageList != imageList || b.imageListFile != imageListFile)
       return true;
     if (b.baseDisplayOptions.timeWindows.count() != baseDisplayOptions.timeWindows.count())
       return true;
@@ -59,9 +70,28 @@ struct AppConfig : public Config {
     std::string overlay = "";
     QString overlayHexRGB = "#FFFFFF";
     QVector<PathEntry> paths;
+    unsigned int prefetchDepth = 2;
+    unsigned int prefetchMemoryMB = 64;
+    unsigned int frameCacheMB = 0;
+    unsigned int frameCacheMemoryMB = 32;
+    unsigned int blurDownscale = 4;
+    unsigned int transitionFps = 30;
+    unsigned int decodeMaxMB = 256;
+    unsigned int decodeMaxMegapixels = 0;
+    std::string metricsFile = ""; // Prometheus text file rewritten every metricsIntervalSeconds
+    unsigned int metricsIntervalSeconds = 15;
+    std::string traceFile = ""; // Chrome trace event JSON of the first traceSwitches image switches
+    unsigned int traceSwitches = 50;
 
     bool debugMode = false;
 
+    // command line only, run without a window (see HeadlessRunner)
+    QSize headlessSize;
+    unsigned int headlessFrames = 100;
+    unsigned int headlessIntervalMsec = 0;
+    std::string headlessFrameDirectory = "";
+    bool headlessFrameCache = false; // time with the frame cache on, which times repeats as lookups
+
     static const std::string valid_aspects; 
   public:
     bool PathOptionsChanged(AppConfig &other) 
@@ -77,8 +107,23 @@ struct AppConfig : public Config {
     }
 };
 
-AppConfig loadAppConfiguration(const AppConfig &commandLineConfig);
-Config getConfigurationForFolder(const std::string &folderPath, const Config &currentConfig);
+// the display options an options.json sets for its folder and everything below it,
+// anything it doesn't set is inherited from the folders above
+struct FolderOptions {
+    bool hasStretch = false;
+    bool stretch = false;
+    bool hasAspect = false;
+    ImageAspectScreenFilter aspect = ImageAspectScreenFilter_Any;
+    bool hasTimes = false; // a folder's times replace its parent's rather than adding to them
+    QVector<DisplayTimeWindow> timeWindows;
+
+    void inheritFrom(const FolderOptions &parent);
+    void applyTo(ImageDisplayOptions &options) const;
+};
+
+// loaded is set when the config file was found and parsed, rather than the command line returned as is
+AppConfig loadAppConfiguration(const AppConfig &commandLineConfig, bool *loaded = nullptr);
+bool loadFolderOptions(const std::string &jsonPath, FolderOptions &options);
 
 ImageAspectScreenFilter parseAspectFromString(char aspect);
 QString getAppConfigFilePath(const std::string &configPath);
@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Benchmarks for the render stages, the overlay and the
+# selector/traverser combinations. Results are written as JSON.
+#
+#-------------------------------------------------
+
+QT       += core gui
+CONFIG += qt console
+CONFIG += c++1z
+CONFIG -= app_bundle
+# numbers from a debug build aren't worth comparing
+CONFIG -= debug
+CONFIG += release
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = slide-bench
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        benchmain.cpp \
+        benchdata.cpp
+
+HEADERS += \
+        benchdata.h
+
+include(../slide.pri)
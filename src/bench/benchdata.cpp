@@ -0,0 +1,110 @@
+#include "benchdata.h"
+#include <QDir>
+#include <QFile>
+#include <QPainter>
+#include <QTextStream>
+#include <unistd.h>
+
+static const int imagesPerFolder = 100;
+static const int foldersPerParent = 100;
+
+// a small LCG, std:: engines and distributions aren't guaranteed the same everywhere
+static quint32 nextRandom(quint32 &state)
+{
+  state = state * 1664525u + 1013904223u;
+  return state >> 8;
+}
+
+QImage MakeSyntheticImage(const QSize &size, quint32 seed)
+{
+  quint32 state = seed;
+  QImage image(size, QImage::Format_RGB32);
+  // smooth gradients compress like photos do, the blocks give the scaler and blur some edges
+  QLinearGradient gradient(0, 0, size.width(), size.height());
+  gradient.setColorAt(0, QColor::fromRgb(nextRandom(state) & 0xffffff));
+  gradient.setColorAt(1, QColor::fromRgb(nextRandom(state) & 0xffffff));
+  QPainter painter(&image);
+  painter.fillRect(image.rect(), gradient);
+  for (int i = 0; i < 64; ++i)
+  {
+    const int w = 1 + nextRandom(state) % (size.width() / 4);
+    const int h = 1 + nextRandom(state) % (size.height() / 4);
+    const int x = nextRandom(state) % size.width();
+    const int y = nextRandom(state) % size.height();
+    painter.fillRect(x, y, w, h, QColor::fromRgb(nextRandom(state) & 0xffffff));
+  }
+  painter.end();
+  return image;
+}
+
+QStringList WriteSeedImages(const QString &folder, const QSize &size, quint32 seed)
+{
+  QDir().mkpath(folder);
+  QStringList paths;
+  const QSize portrait(size.height(), size.width());
+  struct { const char *name; QSize size; } seeds[] = {
+    {"landscape.jpg", size}, {"portrait.jpg", portrait}, {"landscape.png", size}, {"portrait.png", portrait}
+  };
+  for (const auto &seedImage : seeds)
+  {
+    const QString path = QDir(folder).filePath(seedImage.name);
+    if (!QFile::exists(path))
+    {
+      MakeSyntheticImage(seedImage.size, seed++).save(path);
+    }
+    paths.append(path);
+  }
+  return paths;
+}
+
+static QString imageName(int index)
+{
+  // unpadded numbers, so sorting has to compare them by value
+  return QString("IMG_%1.%2").arg(index).arg(index % 4 < 2 ? "jpg" : "png");
+}
+
+bool MakeSyntheticLibrary(const QString &root, int imageCount, const QStringList &seedImages)
+{
+  const QString marker = QDir(root).filePath(".generated");
+  QFile markerFile(marker);
+  if (markerFile.open(QIODevice::ReadOnly) && markerFile.readAll().trimmed().toInt() == imageCount)
+  {
+    return true;
+  }
+  markerFile.close();
+  QDir(root).removeRecursively();
+
+  QFile listFile(QDir(root).filePath("images.m3u"));
+  QDir().mkpath(root);
+  if (!listFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    return false;
+  }
+  QTextStream list(&listFile);
+  for (int index = 0; index < imageCount; ++index)
+  {
+    const int folder = index / imagesPerFolder;
+    const QString folderPath = QString("%1/set_%2/album_%3").arg(root).arg(folder / foldersPerParent).arg(folder);
+    if (index % imagesPerFolder == 0)
+    {
+      QDir().mkpath(folderPath);
+    }
+    const QString path = folderPath + "/" + imageName(index);
+    const QString &seedImage = seedImages[index % seedImages.size()];
+    if (::link(QFile::encodeName(seedImage).constData(), QFile::encodeName(path).constData()) != 0 &&
+        !QFile::copy(seedImage, path))
+    {
+      return false;
+    }
+    list << path << '\n';
+  }
+  list.flush();
+  listFile.close();
+
+  if (!markerFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    return false;
+  }
+  markerFile.write(QByteArray::number(imageCount));
+  return true;
+}
@@ -0,0 +1,24 @@
+#ifndef BENCHDATA_H
+#define BENCHDATA_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+// deterministic test data for the benchmarks, the same seed always gives the same pixels,
+// names and tree, so runs on different machines measure the same work
+
+QImage MakeSyntheticImage(const QSize &size, quint32 seed);
+
+// writes a few seed images (jpg and png, landscape and portrait) to folder, returns their paths
+QStringList WriteSeedImages(const QString &folder, const QSize &size, quint32 seed);
+
+// a tree of imageCount images under root, 100 to a folder and 100 folders to a parent,
+// hard linked to the seed images so a million of them cost directory entries rather than
+// pixels. Also writes root/images.m3u listing them all. Left in place and reused when
+// the same count was generated there before.
+bool MakeSyntheticLibrary(const QString &root, int imageCount, const QStringList &seedImages);
+
+#endif // BENCHDATA_H
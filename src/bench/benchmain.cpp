@@ -0,0 +1,328 @@
+#include "benchdata.h"
+#include "imagerenderer.h"
+#include "imageselector.h"
+#include "pathtraverser.h"
+#include "overlay.h"
+#include "framecache.h"
+#include "logger.h"
+
+#include <QApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFont>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QStaticText>
+#include <QSysInfo>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <getopt.h>
+#include <stdlib.h>
+
+struct BenchOptions
+{
+  QString workDir = QDir::tempPath() + "/slide-bench";
+  QString output; // stdout when empty
+  QString filter; // only benchmarks whose name contains this
+  QVector<int> librarySizes = {1000, 100000, 1000000};
+  int iterations = 20;
+  int selections = 200;
+  QSize screenSize = {1920, 1080};
+};
+
+void usage(std::string programName) {
+    std::cerr << "Usage: " << programName << " [-w work_dir] [-o output.json] [-f name_filter] [-n iterations] [-s selections] [-l library_sizes(1000,100000,...)] [-g WxH]" << std::endl;
+}
+
+bool parseCommandLine(BenchOptions &options, int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "w:o:f:n:s:l:g:")) != -1) {
+    switch (opt) {
+      case 'w':
+        options.workDir = optarg;
+        break;
+      case 'o':
+        options.output = optarg;
+        break;
+      case 'f':
+        options.filter = optarg;
+        break;
+      case 'n':
+        options.iterations = std::max(1, atoi(optarg));
+        break;
+      case 's':
+        options.selections = std::max(1, atoi(optarg));
+        break;
+      case 'l':
+        options.librarySizes.clear();
+        for (const QString &size : QString(optarg).split(','))
+          options.librarySizes.append(size.toInt());
+        break;
+      case 'g':
+      {
+        const QStringList size = QString(optarg).split('x');
+        if (size.size() != 2)
+          return false;
+        options.screenSize = QSize(size[0].toInt(), size[1].toInt());
+        break;
+      }
+      default: /* '?' */
+        return false;
+    }
+  }
+  return true;
+}
+
+// times each call separately and reports the distribution, so a slow outlier on a Pi
+// (a page fault, the governor ramping up) shows in the tail rather than the mean
+class BenchRunner
+{
+public:
+  BenchRunner(const BenchOptions &options): options(options) {}
+
+  bool wanted(const QString &name) const
+  {
+    return options.filter.isEmpty() || name.contains(options.filter);
+  }
+
+  void run(const QString &name, int iterations, const std::function<void()> &work, const QJsonObject &parameters = QJsonObject())
+  {
+    if (!wanted(name))
+      return;
+    work(); // warm up caches and lazy initialisation
+    std::vector<qint64> samples;
+    samples.reserve(iterations);
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i)
+    {
+      timer.start();
+      work();
+      samples.push_back(timer.nsecsElapsed());
+    }
+    record(name, samples, parameters);
+  }
+
+  // for things that can only happen once, like a scan
+  void runOnce(const QString &name, const std::function<void()> &work, const QJsonObject &parameters = QJsonObject())
+  {
+    if (!wanted(name))
+      return;
+    QElapsedTimer timer;
+    timer.start();
+    work();
+    record(name, std::vector<qint64>(1, timer.nsecsElapsed()), parameters);
+  }
+
+  QJsonDocument report() const
+  {
+    QJsonObject root;
+    root["version"] = 1;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["host"] = QSysInfo::machineHostName();
+    root["cpu"] = QSysInfo::currentCpuArchitecture();
+    root["kernel"] = QSysInfo::kernelVersion();
+    root["qt"] = QString(qVersion());
+    root["screen"] = QString("%1x%2").arg(options.screenSize.width()).arg(options.screenSize.height());
+    root["results"] = results;
+    return QJsonDocument(root);
+  }
+
+private:
+  static double percentile(const std::vector<qint64> &sorted, double fraction)
+  {
+    const size_t index = std::min(sorted.size() - 1, (size_t)(fraction * (sorted.size() - 1) + 0.5));
+    return sorted[index] / 1000.0;
+  }
+
+  void record(const QString &name, std::vector<qint64> samples, const QJsonObject &parameters)
+  {
+    std::sort(samples.begin(), samples.end());
+    qint64 total = 0;
+    for (qint64 sample : samples)
+      total += sample;
+    QJsonObject result = parameters;
+    result["name"] = name;
+    result["iterations"] = (int)samples.size();
+    result["min_us"] = samples.front() / 1000.0;
+    result["mean_us"] = total / 1000.0 / samples.size();
+    result["p50_us"] = percentile(samples, 0.5);
+    result["p90_us"] = percentile(samples, 0.9);
+    result["p99_us"] = percentile(samples, 0.99);
+    result["max_us"] = samples.back() / 1000.0;
+    results.append(result);
+    std::cerr << name.toStdString() << ": p50 " << percentile(samples, 0.5) << "us" << std::endl;
+  }
+
+  const BenchOptions &options;
+  QJsonArray results;
+};
+
+void benchRender(BenchRunner &runner, const BenchOptions &options)
+{
+  // a 12MP photo, what a phone or camera gives us
+  const QStringList seeds = WriteSeedImages(options.workDir + "/seed_large", QSize(4000, 3000), 1);
+
+  RenderSettings settings;
+  settings.screenSize = options.screenSize;
+  ImageRenderer renderer(settings);
+
+  ImageDetails details;
+  details.filename = seeds[0].toStdString();
+  details.width = 4000;
+  details.height = 3000;
+  ImageDetails rotatedDetails = details;
+  rotatedDetails.rotation = 90;
+
+  const int iterations = options.iterations;
+  // each stage gets the previous one's output, made up front so a filtered run still has it
+  const QImage loaded = renderer.loadImage(details);
+  const QImage scaled = renderer.getScaledImage(loaded, details);
+  const QImage background = renderer.getBlurredBackground(loaded, scaled, details);
+  runner.run("render.load", iterations, [&]() { renderer.loadImage(details); });
+  runner.run("render.rotate", iterations, [&]() { renderer.getRotatedImage(loaded, rotatedDetails); });
+  runner.run("render.scale", iterations, [&]() { renderer.getScaledImage(loaded, details); });
+  runner.run("render.background", iterations, [&]() { renderer.getBlurredBackground(loaded, scaled, details); });
+  const QImage screenSized = loaded.scaled(options.screenSize, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+  runner.run("render.blur", iterations, [&]() { renderer.blur(screenSized); });
+  runner.run("render.foreground", iterations, [&]() {
+    QImage frame = background;
+    renderer.drawForeground(frame, scaled);
+  });
+
+  // the whole pipeline, without the frame cache turning it into a lookup
+  FrameCache::instance().setLimits(0, 0);
+  runner.run("render.frame", iterations, [&]() { renderer.render(details); });
+
+  Overlay overlay("20|24|<filename> <exifdatetime>;20|24|<time>;20|18|<dir>/<basename>;20|18|<camera>");
+  ImageDetails otherDetails = details;
+  otherDetails.filename = seeds[1].toStdString();
+  bool other = false;
+  // alternate images, rendering the same one again only re-evaluates the clock
+  runner.run("overlay.renderCorners", iterations * 10, [&]() {
+    overlay.renderCorners(other ? otherDetails : details);
+    other = !other;
+  });
+
+  const QStringList corners = overlay.renderCorners(details);
+  const int fontsizes[OverlayCorner_Count] = {overlay.getFontsizeTopLeft(), overlay.getFontsizeTopRight(),
+                                              overlay.getFontsizeBottomLeft(), overlay.getFontsizeBottomRight()};
+  QImage frame = renderer.render(details);
+  runner.run("overlay.drawText", iterations * 10, [&]() {
+    QPainter painter(&frame);
+    painter.setPen(Qt::white);
+    for (int corner = 0; corner < OverlayCorner_Count; ++corner)
+    {
+      QFont font;
+      font.setPixelSize(fontsizes[corner]);
+      QStaticText text(corners[corner]);
+      text.prepare(QTransform(), font);
+      painter.setFont(font);
+      painter.drawStaticText(QPoint(20, 20 + corner * 40), text);
+    }
+  });
+}
+
+std::unique_ptr<PathTraverser> makeTraverser(const QString &kind, const QString &root)
+{
+  if (kind == "list")
+    return std::unique_ptr<PathTraverser>(new ImageListFilePathTraverser((root + "/images.m3u").toStdString()));
+  return std::unique_ptr<PathTraverser>(new RecursivePathTraverser(root.toStdString()));
+}
+
+std::unique_ptr<ImageSelector> makeSelector(const QString &kind, std::unique_ptr<PathTraverser> &traverser)
+{
+  if (kind == "sorted")
+    return std::unique_ptr<ImageSelector>(new SortedImageSelector(traverser));
+  if (kind == "shuffle")
+    return std::unique_ptr<ImageSelector>(new ShuffleImageSelector(traverser));
+  return std::unique_ptr<ImageSelector>(new RandomImageSelector(traverser));
+}
+
+void benchSelection(BenchRunner &runner, const BenchOptions &options)
+{
+  const QStringList seeds = WriteSeedImages(options.workDir + "/seed_small", QSize(640, 480), 2);
+  for (int size : options.librarySizes)
+  {
+    const QString root = QString("%1/library_%2").arg(options.workDir).arg(size);
+    std::cerr << "generating " << size << " images in " << root.toStdString() << std::endl;
+    if (!MakeSyntheticLibrary(root, size, seeds))
+    {
+      std::cerr << "Unable to generate " << root.toStdString() << std::endl;
+      continue;
+    }
+
+    for (const QString traverserKind : {"recursive", "list"})
+    {
+      for (const QString selectorKind : {"random", "shuffle", "sorted"})
+      {
+        const QString name = QString("select.%1.%2.%3").arg(traverserKind).arg(selectorKind).arg(size);
+        if (!runner.wanted(name))
+          continue;
+        QJsonObject parameters;
+        parameters["images"] = size;
+        parameters["traverser"] = traverserKind;
+        parameters["selector"] = selectorKind;
+        // every combination starts with its own scan and a new shuffle pass, image metadata
+        // probed by an earlier one stays in the index just as it would between real runs
+        QDir(options.workDir + "/cache/slide/shuffle").removeRecursively();
+
+        std::unique_ptr<ImageSelector> selector;
+        ImageDisplayOptions displayOptions;
+        runner.runOnce(name + ".first", [&]() {
+          std::unique_ptr<PathTraverser> traverser = makeTraverser(traverserKind, root);
+          selector = makeSelector(selectorKind, traverser);
+          selector->getNextImage(displayOptions);
+        }, parameters);
+        runner.run(name, options.selections, [&]() { selector->getNextImage(displayOptions); }, parameters);
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  // nothing is shown, and the Pis we compare on don't all have a display attached
+  if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+  {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
+  BenchOptions options;
+  if (!parseCommandLine(options, argc, argv))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  QDir().mkpath(options.workDir);
+  // keep the metadata index, shuffle state and frame cache away from the real ones
+  qputenv("XDG_CACHE_HOME", QFile::encodeName(options.workDir + "/cache"));
+
+  QApplication a(argc, argv);
+  SetupLogger(false);
+
+  BenchRunner runner(options);
+  benchRender(runner, options);
+  benchSelection(runner, options);
+
+  const QByteArray json = runner.report().toJson();
+  if (options.output.isEmpty())
+  {
+    std::cout << json.constData();
+    return 0;
+  }
+  QFile output(options.output);
+  if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size())
+  {
+    std::cerr << "Unable to write " << options.output.toStdString() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "configwatcher.h"
+#include "appconfig.h"
+#include "logger.h"
+#include <QDir>
+#include <QFileInfo>
+
+ConfigFileWatcher::ConfigFileWatcher(const std::string &configPath):
+  configPath(configPath),
+  settleTimer(this)
+{
+  settleTimer.setSingleShot(true);
+  connect(&settleTimer, SIGNAL(timeout()), this, SLOT(settled()));
+  connect(&watcher, SIGNAL(fileChanged(QString)), this, SLOT(pathChanged(QString)));
+  connect(&watcher, SIGNAL(directoryChanged(QString)), this, SLOT(pathChanged(QString)));
+
+  configFile = getAppConfigFilePath(configPath);
+  const QFileInfo info(configFile);
+  configExists = !configFile.isEmpty() && info.exists();
+  configModified = info.lastModified();
+  configSize = info.size();
+  watch();
+}
+
+void ConfigFileWatcher::watch()
+{
+  const QString configFolder = QDir(QString::fromStdString(configPath)).absolutePath();
+  if (QFileInfo(configFolder).isDir() && !watcher.directories().contains(configFolder))
+  {
+    watcher.addPath(configFolder);
+  }
+  if (!configFile.isEmpty())
+  {
+    const QString fileFolder = QFileInfo(configFile).absolutePath();
+    if (!watcher.directories().contains(fileFolder))
+    {
+      watcher.addPath(fileFolder);
+    }
+    if (QFileInfo::exists(configFile) && !watcher.files().contains(configFile))
+    {
+      watcher.addPath(configFile);
+    }
+  }
+}
+
+void ConfigFileWatcher::pathChanged(const QString &path)
+{
+  Q_UNUSED(path);
+  settleTimer.start(settleMsec);
+}
+
+void ConfigFileWatcher::settled()
+{
+  // the file that is used may be a different one now, one earlier in the search order may have appeared
+  const QString file = getAppConfigFilePath(configPath);
+  const QFileInfo info(file);
+  const bool exists = !file.isEmpty() && info.exists();
+  const bool different = file != configFile || exists != configExists ||
+                         info.lastModified() != configModified || info.size() != configSize;
+  configFile = file;
+  configExists = exists;
+  configModified = info.lastModified();
+  configSize = info.size();
+  watch();
+  if (different)
+  {
+    Log("Config file changed: ", configFile.toStdString());
+    emit changed();
+  }
+}
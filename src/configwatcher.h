@@ -0,0 +1,40 @@
+#ifndef CONFIGWATCHER_H
+#define CONFIGWATCHER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QFileSystemWatcher>
+#include <QString>
+#include <QTimer>
+#include <string>
+
+// tells when the app config file has changed, once it has settled. Its folder is watched
+// too: editors often save by renaming a new file over the old one, which drops the watch
+// on the file, and the file may not exist yet when slide starts.
+class ConfigFileWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    ConfigFileWatcher(const std::string &configPath);
+
+signals:
+    void changed();
+
+private slots:
+    void pathChanged(const QString &path);
+    void settled();
+
+private:
+    void watch();
+
+    const std::string configPath;
+    QFileSystemWatcher watcher;
+    QTimer settleTimer;
+    const int settleMsec = 250; // a save is usually a few writes close together
+    QString configFile;
+    bool configExists = false;
+    QDateTime configModified;
+    qint64 configSize = 0;
+};
+
+#endif // CONFIGWATCHER_H
@@ -0,0 +1,97 @@
+#include "folderoptionscache.h"
+#include "logger.h"
+#include <QDateTime>
+#include <QFileInfo>
+
+FolderOptionsCache &FolderOptionsCache::instance()
+{
+  static FolderOptionsCache cache;
+  return cache;
+}
+
+const FolderOptions &FolderOptionsCache::folderOptions(const QString &directoryPath, qint64 now)
+{
+  Folder &folder = folders[directoryPath];
+  if (folder.checkedAt != 0 && now - folder.checkedAt < recheckMsecs)
+  {
+    return folder.options;
+  }
+  folder.checkedAt = now;
+
+  const QFileInfo info(directoryPath + "/options.json");
+  const bool exists = info.exists();
+  const qint64 modified = exists ? info.lastModified().toMSecsSinceEpoch() : 0;
+  const qint64 size = exists ? info.size() : 0;
+  if (exists == folder.exists && modified == folder.modified && size == folder.size)
+  {
+    return folder.options;
+  }
+  folder.exists = exists;
+  folder.modified = modified;
+  folder.size = size;
+  folder.options = FolderOptions();
+  if (exists)
+  {
+    loadFolderOptions(info.filePath().toStdString(), folder.options);
+  }
+  ++version;
+  return folder.options;
+}
+
+FolderOptions FolderOptionsCache::resolveFrom(const QString &rootPath, const QString &directoryPath, qint64 now)
+{
+  // folders outside the root (an image list entry, a symlink) only get their own options
+  int start = directoryPath.size();
+  if (directoryPath.startsWith(rootPath) && (directoryPath.size() == rootPath.size() || directoryPath[rootPath.size()] == '/'))
+  {
+    start = rootPath.size();
+  }
+  else if (rootPath == "/" && directoryPath.startsWith('/'))
+  {
+    start = 1;
+  }
+
+  FolderOptions options = folderOptions(directoryPath.left(start), now);
+  while (start < directoryPath.size())
+  {
+    int end = directoryPath.indexOf('/', start + 1);
+    if (end < 0)
+    {
+      end = directoryPath.size();
+    }
+    FolderOptions child = folderOptions(directoryPath.left(end), now);
+    child.inheritFrom(options);
+    options = child;
+    start = end;
+  }
+  return options;
+}
+
+quint64 FolderOptionsCache::getVersion()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return version;
+}
+
+ImageDisplayOptions FolderOptionsCache::resolve(const QString &rootPath, const QString &directoryPath, const ImageDisplayOptions &baseOptions)
+{
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
+  const QString key = rootPath + '\n' + directoryPath;
+  ImageDisplayOptions options = baseOptions;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = resolved.find(key);
+  if (it == resolved.end() || it->version != version || now - it->checkedAt >= recheckMsecs)
+  {
+    FolderOptions folderOptions = resolveFrom(rootPath, directoryPath, now);
+    // resolving may have noticed a change, the entry is current as of the version it ends on
+    Resolved &entry = resolved[key];
+    entry.version = version;
+    entry.checkedAt = now;
+    entry.options = folderOptions;
+    entry.options.applyTo(options);
+    return options;
+  }
+  it->options.applyTo(options);
+  return options;
+}
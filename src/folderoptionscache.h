@@ -0,0 +1,50 @@
+#ifndef FOLDEROPTIONSCACHE_H
+#define FOLDEROPTIONSCACHE_H
+
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+#include <mutex>
+#include "appconfig.h"
+
+// parsed options.json files, so resolving an image's options is a hash lookup rather
+// than a stat, read and parse each time. The options for a folder are every options.json
+// from the traverser's root down to it applied in turn. Files are re-checked by size and
+// mtime at most every few seconds, so edits show up without a watcher per folder.
+class FolderOptionsCache
+{
+public:
+    static FolderOptionsCache &instance();
+
+    ImageDisplayOptions resolve(const QString &rootPath, const QString &directoryPath, const ImageDisplayOptions &baseOptions);
+    // moves on whenever an options.json appears, changes or goes away
+    quint64 getVersion();
+
+private:
+    struct Folder
+    {
+        bool exists = false;
+        qint64 modified = 0;
+        qint64 size = 0;
+        qint64 checkedAt = 0;
+        FolderOptions options; // what this folder's own options.json sets
+    };
+    struct Resolved
+    {
+        quint64 version = 0;
+        qint64 checkedAt = 0;
+        FolderOptions options; // with everything from the root down inherited
+    };
+
+    FolderOptionsCache() {}
+    const FolderOptions &folderOptions(const QString &directoryPath, qint64 now);
+    FolderOptions resolveFrom(const QString &rootPath, const QString &directoryPath, qint64 now);
+
+    const qint64 recheckMsecs = 10 * 1000;
+    std::mutex mutex;
+    QHash<QString, Folder> folders;
+    QHash<QString, Resolved> resolved; // keyed by root and folder, stale once version moves on
+    quint64 version = 0; // bumped whenever any options.json appears, changes or goes away
+};
+
+#endif // FOLDEROPTIONSCACHE_H
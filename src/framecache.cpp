@@ -0,0 +1,280 @@
+#include "framecache.h"
+#include "metadataindex.h"
+#include "logger.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QStringList>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <utime.h>
+
+static const char frameMagic[4] = {'S','L','F','R'};
+static const quint32 frameVersion = 2;
+static const int staleTempSeconds = 10 * 60;
+
+// 64 bytes so the pixel data after it stays nicely aligned in the mapping
+struct FrameHeader
+{
+    char magic[4];
+    quint32 version;
+    qint32 width;
+    qint32 height;
+    qint32 bytesPerLine;
+    qint32 format;
+    char reserved[40];
+};
+static_assert(sizeof(FrameHeader) == 64, "frame header should stay 64 bytes");
+
+static void closeMappedFrame(void *info)
+{
+  // deleting the QFile removes the mapping
+  delete static_cast<QFile*>(info);
+}
+
+FrameCache &FrameCache::instance()
+{
+  static FrameCache cache;
+  return cache;
+}
+
+FrameCache::FrameCache()
+{
+  QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation));
+  cacheDirectory = cacheDir.filePath("slide/frames");
+  memoryCache.setMaxCost(0);
+}
+
+void FrameCache::setLimits(unsigned int diskMB, unsigned int memoryMB)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  memoryCache.setMaxCost(memoryMB * 1024);
+  diskLimit = (qint64)diskMB * 1024 * 1024;
+  if (diskLimit > 0)
+  {
+    QDir().mkpath(cacheDirectory);
+    if (diskUsage < 0)
+    {
+      scanDiskUsage();
+    }
+    evictDisk();
+  }
+}
+
+QString FrameCache::keyFor(const ImageDetails &imageDetails, const RenderSettings &settings) const
+{
+  // the selector has just checked the file, only stat it again if it didn't
+  ImageMetadata fileInfo = imageDetails.metadata;
+  if (fileInfo.fileSize <= 0 && !MetadataIndex::statFile(imageDetails.filename, fileInfo))
+  {
+    return QString();
+  }
+
+  QStringList parts;
+  parts << QString::number(frameVersion)
+        << QString::fromStdString(imageDetails.filename)
+        << QString::number(fileInfo.fileSize)
+        << QString::number(fileInfo.modifiedTime)
+        << QString::number(settings.screenSize.width())
+        << QString::number(settings.screenSize.height())
+        << QString::number(settings.blurRadius)
+        << QString::number(settings.backgroundOpacity)
+        << QString::number(settings.blurDownscale)
+        << QString::number(imageDetails.options.fitAspectAxisToWindow ? 1 : 0)
+        << QString::number(imageDetails.rotation);
+  return QString::fromLatin1(QCryptographicHash::hash(parts.join('|').toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+QString FrameCache::framePath(const QString &key) const
+{
+  return cacheDirectory + "/" + key + ".frame";
+}
+
+QImage FrameCache::find(const QString &key)
+{
+  if (key.isEmpty())
+  {
+    return QImage();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  QImage *cached = memoryCache.object(key);
+  if (cached != nullptr)
+  {
+    Log("frame cache: memory hit");
+    return *cached;
+  }
+  if (diskLimit <= 0)
+  {
+    return QImage();
+  }
+
+  const QString path = framePath(key);
+  QImage frame = loadFrame(path);
+  if (frame.isNull())
+  {
+    return QImage();
+  }
+  Log("frame cache: disk hit");
+  ::utime(QFile::encodeName(path).constData(), nullptr); // bump it in the LRU order
+  memoryCache.insert(key, new QImage(frame), frame.bytesPerLine() * frame.height() / 1024);
+  return frame;
+}
+
+void FrameCache::insert(const QString &key, const QImage &frame)
+{
+  if (key.isEmpty() || frame.isNull())
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    memoryCache.insert(key, new QImage(frame), frame.bytesPerLine() * frame.height() / 1024);
+    if (diskLimit <= 0)
+    {
+      return;
+    }
+  }
+
+  // writing a few MB to an SD card takes a while, so it happens without the lock and every
+  // other worker's lookups carry on; only the finished file is renamed into place under it
+  const QString path = framePath(key);
+  const QString tempPath = writeTempFrame(path, frame);
+  if (tempPath.isEmpty())
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  // another worker may have written the same frame meanwhile, the rename replaces it
+  const QFileInfo replaced(path);
+  const qint64 replacedSize = replaced.exists() ? replaced.size() : 0;
+  if (diskLimit <= 0 || ::rename(QFile::encodeName(tempPath).constData(), QFile::encodeName(path).constData()) != 0)
+  {
+    QFile::remove(tempPath);
+    return;
+  }
+  diskUsage += QFileInfo(path).size() - replacedSize;
+  evictDisk();
+}
+
+QImage FrameCache::loadFrame(const QString &path) const
+{
+  QFile *file = new QFile(path);
+  if (!file->open(QIODevice::ReadOnly) || file->size() < (qint64)sizeof(FrameHeader))
+  {
+    delete file;
+    return QImage();
+  }
+  const qint64 size = file->size();
+  const uchar *data = file->map(0, size);
+  if (data == nullptr)
+  {
+    delete file;
+    return QImage();
+  }
+
+  const FrameHeader *header = reinterpret_cast<const FrameHeader*>(data);
+  if (memcmp(header->magic, frameMagic, sizeof(frameMagic)) != 0 || header->version != frameVersion ||
+      header->width <= 0 || header->height <= 0 || header->bytesPerLine < header->width * 4 ||
+      (qint64)sizeof(FrameHeader) + (qint64)header->bytesPerLine * header->height > size)
+  {
+    Log("frame cache: ignoring bad frame ", path.toStdString());
+    delete file;
+    return QImage();
+  }
+
+  // the image reads straight from the mapping, which lives until the last copy of the image goes away
+  return QImage(data + sizeof(FrameHeader), header->width, header->height, header->bytesPerLine,
+                (QImage::Format)header->format, closeMappedFrame, file);
+}
+
+QString FrameCache::writeTempFrame(const QString &path, const QImage &frameIn) const
+{
+  // workers may compose the same frame at once, each writes its own file
+  static std::atomic<quint32> nextTempFile{0};
+
+  // only 32 bit formats are allowed back in by loadFrame
+  const QImage frame = frameIn.depth() == 32 ? frameIn : frameIn.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+  FrameHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, frameMagic, sizeof(frameMagic));
+  header.version = frameVersion;
+  header.width = frame.width();
+  header.height = frame.height();
+  header.bytesPerLine = frame.bytesPerLine();
+  header.format = frame.format();
+
+  const QString tempPath = path + "." + QString::number(QCoreApplication::applicationPid()) + "." + QString::number(nextTempFile++);
+  QFile file(tempPath);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    Log("frame cache: failed to write ", tempPath.toStdString());
+    return QString();
+  }
+  bool ok = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+  for (int y = 0; ok && y < frame.height(); ++y)
+  {
+    ok = file.write(reinterpret_cast<const char*>(frame.constScanLine(y)), frame.bytesPerLine()) == frame.bytesPerLine();
+  }
+  file.close();
+  if (!ok)
+  {
+    Log("frame cache: failed to write ", tempPath.toStdString());
+    QFile::remove(tempPath);
+    return QString();
+  }
+  return tempPath;
+}
+
+void FrameCache::scanDiskUsage()
+{
+  diskUsage = 0;
+  QDir directory(cacheDirectory);
+  for (const QFileInfo &info : directory.entryInfoList(QStringList() << "*.frame", QDir::Files))
+  {
+    diskUsage += info.size();
+  }
+  // left by a process that stopped before renaming them into place. Another slide sharing the
+  // cache may be writing one right now, so only ones nobody has touched in a while
+  const QDateTime staleBefore = QDateTime::currentDateTime().addSecs(-staleTempSeconds);
+  for (const QFileInfo &info : directory.entryInfoList(QStringList() << "*.frame.*", QDir::Files))
+  {
+    if (info.lastModified() < staleBefore)
+    {
+      Log("frame cache: removing unfinished ", info.fileName().toStdString());
+      QFile::remove(info.filePath());
+    }
+  }
+  Log("frame cache: ", diskUsage / (1024 * 1024), "MB on disk");
+}
+
+void FrameCache::evictDisk()
+{
+  if (diskUsage <= diskLimit)
+  {
+    return;
+  }
+
+  // oldest first, hits bump the modification time so this is least recently used
+  QDir directory(cacheDirectory);
+  const QFileInfoList frames = directory.entryInfoList(QStringList() << "*.frame", QDir::Files, QDir::Time | QDir::Reversed);
+  const qint64 target = diskLimit - diskLimit / 10;
+  for (const QFileInfo &info : frames)
+  {
+    if (diskUsage <= target)
+    {
+      break;
+    }
+    if (QFile::remove(info.filePath()))
+    {
+      diskUsage -= info.size();
+    }
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QString>
+#include <mutex>
+#include "imagestructs.h"
+#include "imagerenderer.h"
+
+// cache of fully composed frames (without the overlay), keyed by the image file
+// and everything that changes how it is composed. A small in-memory tier sits
+// in front of an LRU capped disk tier of raw frames under ~/.cache/slide/frames
+// that can be memory mapped straight back into a QImage.
+class FrameCache
+{
+public:
+    static FrameCache &instance();
+
+    void setLimits(unsigned int diskMB, unsigned int memoryMB);
+    QString keyFor(const ImageDetails &imageDetails, const RenderSettings &settings) const;
+    QImage find(const QString &key);
+    void insert(const QString &key, const QImage &frame);
+
+private:
+    FrameCache();
+    QString framePath(const QString &key) const;
+    QImage loadFrame(const QString &path) const;
+    QString writeTempFrame(const QString &path, const QImage &frame) const;
+    void scanDiskUsage();
+    void evictDisk();
+
+    std::mutex mutex;
+    QString cacheDirectory;
+    QCache<QString, QImage> memoryCache; // cost in KB
+    qint64 diskLimit = 0;
+    qint64 diskUsage = -1; // -1 until the cache folder has been scanned
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,130 @@
+#include "headlessrunner.h"
+#include "logger.h"
+#include "trace.h"
+#include "metrics.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <algorithm>
+#include <iostream>
+
+HeadlessRunner::HeadlessRunner(const HeadlessSettings &settingsIn, const RenderSettings &renderSettings,
+                               const ImageDisplayOptions &baseOptionsIn, std::unique_ptr<ImageSelector> &selectorIn):
+  settings(settingsIn),
+  renderer(renderSettings),
+  baseOptions(baseOptionsIn),
+  selector(std::move(selectorIn)),
+  timer(this)
+{
+  if (baseOptions.onlyAspect == ImageAspectScreenFilter_Monitor)
+  {
+    baseOptions.onlyAspect = settings.screenSize.width() >= settings.screenSize.height() ? ImageAspectScreenFilter_Landscape : ImageAspectScreenFilter_Portrait;
+  }
+  selectNsecs.reserve(settings.frameCount);
+  renderNsecs.reserve(settings.frameCount);
+  totalNsecs.reserve(settings.frameCount);
+  timer.setTimerType(Qt::PreciseTimer);
+  connect(&timer, SIGNAL(timeout()), this, SLOT(step()));
+}
+
+void HeadlessRunner::start()
+{
+  if (!settings.frameDirectory.isEmpty())
+  {
+    QDir().mkpath(settings.frameDirectory);
+  }
+  frameCacheHits = Metrics::frameCacheHits.get();
+  frameCacheMisses = Metrics::frameCacheMisses.get();
+  clock.start();
+  // a zero interval timer still lets queued events (library updates) through between images
+  timer.start(settings.intervalMsec);
+}
+
+void HeadlessRunner::step()
+{
+  if (totalNsecs.size() >= settings.frameCount || attempts >= settings.frameCount * 2)
+  {
+    finish();
+    return;
+  }
+  ++attempts;
+
+  Trace::instance().switchStarting();
+  TraceSpan span("frame");
+  QElapsedTimer imageClock;
+  imageClock.start();
+  ImageDetails imageDetails;
+  {
+    TraceSpan selectSpan("select");
+    imageDetails = selector->getNextImage(baseOptions);
+  }
+  const qint64 selected = imageClock.nsecsElapsed();
+  if (imageDetails.filename.empty())
+  {
+    ++failures;
+    return;
+  }
+  const QImage frame = renderer.render(imageDetails);
+  const qint64 total = imageClock.nsecsElapsed();
+  if (frame.isNull())
+  {
+    Log("Unable to render ", imageDetails.filename);
+    ++failures;
+    return;
+  }
+  selectNsecs.push_back(selected);
+  renderNsecs.push_back(total - selected);
+  totalNsecs.push_back(total);
+  if (settings.intervalMsec > 0 && total > (qint64)settings.intervalMsec * 1000000)
+  {
+    ++late;
+  }
+
+  // saving isn't part of the pipeline being measured
+  if (!settings.frameDirectory.isEmpty())
+  {
+    const QString name = QString("frame_%1.jpg").arg(totalNsecs.size(), 5, 10, QChar('0'));
+    frame.save(QDir(settings.frameDirectory).filePath(name), "JPG", 90);
+  }
+}
+
+static double percentileMsec(std::vector<qint64> samples, double fraction)
+{
+  if (samples.empty())
+  {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  const size_t index = std::min(samples.size() - 1, (size_t)(fraction * (samples.size() - 1) + 0.5));
+  return samples[index] / 1000000.0;
+}
+
+void HeadlessRunner::finish()
+{
+  timer.stop();
+  const double seconds = clock.nsecsElapsed() / 1e9;
+  const size_t images = totalNsecs.size();
+  std::cout << "headless " << settings.screenSize.width() << "x" << settings.screenSize.height() << ": "
+            << images << " images in " << seconds << "s, " << (seconds > 0 ? images / seconds : 0) << " images/sec, "
+            << failures << " failed";
+  if (settings.intervalMsec > 0)
+  {
+    std::cout << ", " << late << " slower than the " << settings.intervalMsec << "ms interval";
+  }
+  std::cout << std::endl;
+  if (settings.frameCache)
+  {
+    std::cout << "  frame cache: " << Metrics::frameCacheHits.get() - frameCacheHits << " hits, "
+              << Metrics::frameCacheMisses.get() - frameCacheMisses << " misses" << std::endl;
+  }
+  const struct { const char *name; const std::vector<qint64> &samples; } stages[] = {
+    {"latency", totalNsecs}, {"select", selectNsecs}, {"render", renderNsecs}
+  };
+  for (const auto &stage : stages)
+  {
+    std::cout << "  " << stage.name << " ms: p50 " << percentileMsec(stage.samples, 0.5)
+              << " p90 " << percentileMsec(stage.samples, 0.9)
+              << " p99 " << percentileMsec(stage.samples, 0.99)
+              << " max " << percentileMsec(stage.samples, 1.0) << std::endl;
+  }
+  QCoreApplication::exit(images > 0 ? 0 : 1);
+}
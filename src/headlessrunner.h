@@ -0,0 +1,56 @@
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QSize>
+#include <QString>
+#include <QTimer>
+#include <memory>
+#include <vector>
+#include "imageselector.h"
+#include "imagerenderer.h"
+
+struct HeadlessSettings
+{
+    QSize screenSize;
+    unsigned int frameCount = 100;
+    unsigned int intervalMsec = 0; // 0 to go as fast as possible
+    QString frameDirectory; // composed frames are saved here when set
+    bool frameCache = false; // the frame cache is on, report its hits and misses with the timings
+};
+
+// runs the selector and renderer with no window, either flat out or at a simulated rotation
+// interval, and reports images/sec and per image latency once frameCount images are done.
+// Used for sizing hardware and catching regressions on machines without a display.
+class HeadlessRunner : public QObject
+{
+    Q_OBJECT
+public:
+    HeadlessRunner(const HeadlessSettings &settings, const RenderSettings &renderSettings,
+                   const ImageDisplayOptions &baseOptions, std::unique_ptr<ImageSelector> &selector);
+    void start();
+
+private slots:
+    void step();
+
+private:
+    void finish();
+
+    const HeadlessSettings settings;
+    const ImageRenderer renderer;
+    ImageDisplayOptions baseOptions;
+    std::unique_ptr<ImageSelector> selector;
+    QTimer timer;
+    QElapsedTimer clock;
+    unsigned int attempts = 0;
+    unsigned int failures = 0;
+    unsigned int late = 0; // took longer than the interval, so would have been shown late
+    quint64 frameCacheHits = 0; // the counters when we started
+    quint64 frameCacheMisses = 0;
+    std::vector<qint64> selectNsecs;
+    std::vector<qint64> renderNsecs;
+    std::vector<qint64> totalNsecs;
+};
+
+#endif // HEADLESSRUNNER_H
@@ -0,0 +1,332 @@
+#include "imagedecoder.h"
+#include "logger.h"
+#include "metrics.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QPixelFormat>
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <vector>
+#include <png.h>
+#include <tiffio.h>
+
+// averages source rows into a target sized image as they arrive, so only one row of
+// column sums is ever held on top of the output
+class BoxDownsampler
+{
+public:
+  bool begin(const QSize &sourceSizeIn, const QSize &targetSizeIn)
+  {
+    sourceSize = sourceSizeIn;
+    targetSize = targetSizeIn.boundedTo(sourceSize);
+    image = QImage(targetSize, QImage::Format_ARGB32_Premultiplied);
+    if (image.isNull())
+    {
+      return false;
+    }
+    image.fill(Qt::black); // rows a truncated file never delivers stay black
+    sums.assign(targetSize.width() * 4, 0);
+    columnOf.resize(sourceSize.width());
+    columnWidth.assign(targetSize.width(), 0);
+    for (int x = 0; x < sourceSize.width(); ++x)
+    {
+      columnOf[x] = (int)((qint64)x * targetSize.width() / sourceSize.width());
+      ++columnWidth[columnOf[x]];
+    }
+    return true;
+  }
+
+  // premultiplied pixels, sourceSize.width() of them, top row first
+  void addRow(const QRgb *row)
+  {
+    const int targetRow = (int)((qint64)sourceRow * targetSize.height() / sourceSize.height());
+    if (targetRow != outputRow && rowsInBand > 0)
+    {
+      emitRow();
+    }
+    outputRow = targetRow;
+    for (int x = 0; x < sourceSize.width(); ++x)
+    {
+      const QRgb pixel = row[x];
+      quint32 *sum = &sums[columnOf[x] * 4];
+      sum[0] += qAlpha(pixel);
+      sum[1] += qRed(pixel);
+      sum[2] += qGreen(pixel);
+      sum[3] += qBlue(pixel);
+    }
+    ++rowsInBand;
+    if (++sourceRow == sourceSize.height())
+    {
+      emitRow();
+    }
+  }
+
+  QImage result() const { return image; }
+
+private:
+  void emitRow()
+  {
+    QRgb *out = reinterpret_cast<QRgb*>(image.scanLine(outputRow));
+    for (int x = 0; x < targetSize.width(); ++x)
+    {
+      quint32 *sum = &sums[x * 4];
+      const quint32 count = columnWidth[x] * rowsInBand;
+      const quint32 half = count / 2;
+      out[x] = qRgba((sum[1] + half) / count, (sum[2] + half) / count, (sum[3] + half) / count, (sum[0] + half) / count);
+      sum[0] = sum[1] = sum[2] = sum[3] = 0;
+    }
+    rowsInBand = 0;
+  }
+
+  QSize sourceSize;
+  QSize targetSize;
+  QImage image;
+  std::vector<quint32> sums; // alpha, red, green, blue per target column
+  std::vector<int> columnOf; // target column of every source column
+  std::vector<quint32> columnWidth; // source columns per target column
+  int sourceRow = 0;
+  int outputRow = 0;
+  int rowsInBand = 0;
+};
+
+static void pngError(png_structp png, png_const_charp message)
+{
+  Log("png: ", message);
+  longjmp(png_jmpbuf(png), 1);
+}
+
+static void pngWarning(png_structp, png_const_charp)
+{
+}
+
+static QImage DecodePngDownsampled(const QString &fileName, const QSize &targetSize)
+{
+  FILE *file = fopen(QFile::encodeName(fileName).constData(), "rb");
+  if (file == nullptr)
+  {
+    return QImage();
+  }
+
+  // everything that needs cleaning up exists before setjmp, libpng errors jump back to it
+  BoxDownsampler downsampler;
+  std::vector<png_byte> rowBytes;
+  std::vector<QRgb> pixels;
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+  png_infop info = png != nullptr ? png_create_info_struct(png) : nullptr;
+  if (info == nullptr || setjmp(png_jmpbuf(png)))
+  {
+    png_destroy_read_struct(&png, info != nullptr ? &info : nullptr, nullptr);
+    fclose(file);
+    return QImage();
+  }
+
+  png_init_io(png, file);
+  png_read_info(png, info);
+  const png_uint_32 width = png_get_image_width(png, info);
+  const png_uint_32 height = png_get_image_height(png, info);
+  const int colorType = png_get_color_type(png, info);
+  const int bitDepth = png_get_bit_depth(png, info);
+  if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE)
+  {
+    // passes revisit every row, so there is no way around holding the whole image
+    Log("skipping ", fileName.toStdString(), ": interlaced PNGs this large can't be decoded within the memory limit");
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(file);
+    return QImage();
+  }
+
+  // normalise everything to 8 bit RGBA on the fly
+  if (bitDepth == 16)
+    png_set_strip_16(png);
+  if (colorType == PNG_COLOR_TYPE_PALETTE)
+    png_set_palette_to_rgb(png);
+  if (colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8)
+    png_set_expand_gray_1_2_4_to_8(png);
+  const bool hasTransparency = png_get_valid(png, info, PNG_INFO_tRNS) != 0;
+  if (hasTransparency)
+    png_set_tRNS_to_alpha(png);
+  if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA)
+    png_set_gray_to_rgb(png);
+  if (!(colorType & PNG_COLOR_MASK_ALPHA) && !hasTransparency)
+    png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+  png_read_update_info(png, info);
+
+  if (png_get_rowbytes(png, info) != width * 4 || !downsampler.begin(QSize(width, height), targetSize))
+  {
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(file);
+    return QImage();
+  }
+  rowBytes.resize(width * 4);
+  pixels.resize(width);
+  for (png_uint_32 y = 0; y < height; ++y)
+  {
+    png_read_row(png, rowBytes.data(), nullptr);
+    const png_byte *rgba = rowBytes.data();
+    for (png_uint_32 x = 0; x < width; ++x, rgba += 4)
+    {
+      pixels[x] = qPremultiply(qRgba(rgba[0], rgba[1], rgba[2], rgba[3]));
+    }
+    downsampler.addRow(pixels.data());
+  }
+
+  png_destroy_read_struct(&png, &info, nullptr);
+  fclose(file);
+  return downsampler.result();
+}
+
+static QImage DecodeTiffDownsampled(const QString &fileName, const QSize &targetSize, quint64 maxBytes)
+{
+  TIFF *tiff = TIFFOpen(QFile::encodeName(fileName).constData(), "r");
+  if (tiff == nullptr)
+  {
+    return QImage();
+  }
+
+  char message[1024];
+  TIFFRGBAImage rgba;
+  if (!TIFFRGBAImageOK(tiff, message) || !TIFFRGBAImageBegin(&rgba, tiff, 0, message))
+  {
+    Log("tiff: ", fileName.toStdString(), ": ", message);
+    TIFFClose(tiff);
+    return QImage();
+  }
+  rgba.req_orientation = ORIENTATION_TOPLEFT;
+  const uint32_t width = rgba.width;
+  const uint32_t height = rgba.height;
+
+  // libtiff decodes a whole strip (or row of tiles) at a time, go one of those at a time
+  uint32_t bandRows = 0;
+  if (TIFFIsTiled(tiff))
+    TIFFGetField(tiff, TIFFTAG_TILELENGTH, &bandRows);
+  else
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &bandRows);
+  bandRows = std::max(1u, std::min(bandRows, height));
+  // the band is decoded, then converted into the raster, so it counts twice
+  if (maxBytes > 0 && (quint64)width * bandRows * 4 * 2 > maxBytes)
+  {
+    Log("skipping ", fileName.toStdString(), ": its strips are too large to decode within the memory limit");
+    TIFFRGBAImageEnd(&rgba);
+    TIFFClose(tiff);
+    return QImage();
+  }
+
+  BoxDownsampler downsampler;
+  std::vector<uint32_t> raster;
+  std::vector<QRgb> pixels(width);
+  bool ok = downsampler.begin(QSize(width, height), targetSize);
+  if (ok)
+  {
+    raster.resize((size_t)width * bandRows);
+  }
+  for (uint32_t row = 0; ok && row < height; row += bandRows)
+  {
+    const uint32_t rows = std::min(bandRows, height - row);
+    rgba.row_offset = row;
+    rgba.col_offset = 0;
+    ok = TIFFRGBAImageGet(&rgba, raster.data(), width, rows) != 0;
+    for (uint32_t y = 0; ok && y < rows; ++y)
+    {
+      // libtiff hands back premultiplied ABGR
+      const uint32_t *source = &raster[(size_t)y * width];
+      for (uint32_t x = 0; x < width; ++x)
+      {
+        const uint32_t pixel = source[x];
+        pixels[x] = qRgba(TIFFGetR(pixel), TIFFGetG(pixel), TIFFGetB(pixel), TIFFGetA(pixel));
+      }
+      downsampler.addRow(pixels.data());
+    }
+  }
+
+  TIFFRGBAImageEnd(&rgba);
+  TIFFClose(tiff);
+  if (!ok)
+  {
+    Log("tiff: failed to decode ", fileName.toStdString());
+    return QImage();
+  }
+  return downsampler.result();
+}
+
+// what reading the whole image at its native size would allocate
+static quint64 fullDecodeBytes(QImageReader &reader, const QSize &sourceSize)
+{
+  int bytesPerPixel = 4;
+  const QImage::Format format = reader.imageFormat();
+  if (format != QImage::Format_Invalid)
+  {
+    bytesPerPixel = std::max(bytesPerPixel, (int)QImage::toPixelFormat(format).bitsPerPixel() / 8);
+  }
+  return (quint64)sourceSize.width() * sourceSize.height() * bytesPerPixel;
+}
+
+QImage DecodeImage(QImageReader &reader, const QSize &decodeSize, const DecodeLimits &limits)
+{
+  StageTimer timer(Metrics::decode);
+  const QString fileName = reader.fileName();
+  const QSize sourceSize = reader.size();
+  if (sourceSize.isValid())
+  {
+    const quint64 sourcePixels = (quint64)sourceSize.width() * sourceSize.height();
+    if (limits.maxPixels > 0 && sourcePixels > limits.maxPixels)
+    {
+      Log("skipping ", fileName.toStdString(), ": ", sourceSize.width(), "x", sourceSize.height(), " is over the ",
+          limits.maxPixels / 1000000, " megapixel limit");
+      return QImage();
+    }
+
+    // jpegs never get decoded at full size thanks to DCT scaling, anything else does
+    const QByteArray format = reader.format();
+    if (format != "jpeg" && limits.maxBytes > 0 && fullDecodeBytes(reader, sourceSize) > limits.maxBytes)
+    {
+      Log("streaming ", fileName.toStdString(), " (", sourceSize.width(), "x", sourceSize.height(), ") down to ",
+          decodeSize.width(), "x", decodeSize.height());
+      if (format == "png")
+      {
+        return DecodePngDownsampled(fileName, decodeSize);
+      }
+      if (format == "tiff")
+      {
+        return DecodeTiffDownsampled(fileName, decodeSize, limits.maxBytes);
+      }
+      Log("skipping ", fileName.toStdString(), ": decoding it would need more than ", limits.maxBytes / (1024 * 1024), "MB");
+      return QImage();
+    }
+
+    if (decodeSize != sourceSize)
+    {
+      // the jpeg plugin turns this into libjpeg DCT scaling (1/2, 1/4 or 1/8) so the
+      // full resolution image never exists in memory
+      Log("decoding ", sourceSize.width(), "x", sourceSize.height(), " at ", decodeSize.width(), "x", decodeSize.height());
+      reader.setScaledSize(decodeSize);
+    }
+  }
+  else if (limits.maxBytes > 0 && (quint64)QFileInfo(fileName).size() > limits.maxBytes)
+  {
+    // nothing to plan the decode with, but it won't come out smaller than the file
+    Log("skipping ", fileName.toStdString(), ": no size in its header and the file is over ",
+        limits.maxBytes / (1024 * 1024), "MB");
+    return QImage();
+  }
+
+  QImage image = reader.read();
+  if (image.isNull())
+  {
+    Log("failed to load ", fileName.toStdString(), ": ", reader.errorString().toStdString());
+  }
+  else if (!sourceSize.isValid() && !FitsDecodeLimits(image, limits))
+  {
+    Log("skipping ", fileName.toStdString(), ": ", image.width(), "x", image.height(), " is over the decode limits");
+    return QImage();
+  }
+  return image;
+}
+
+bool FitsDecodeLimits(const QImage &image, const DecodeLimits &limits)
+{
+  const quint64 pixels = (quint64)image.width() * image.height();
+  return (limits.maxPixels == 0 || pixels <= limits.maxPixels) &&
+         (limits.maxBytes == 0 || (quint64)image.sizeInBytes() <= limits.maxBytes);
+}
@@ -0,0 +1,34 @@
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <QImage>
+#include <QSize>
+#include <QtGlobal>
+
+class QImageReader;
+
+// caps on what decoding a single image may cost
+struct DecodeLimits
+{
+    quint64 maxBytes = 256 * 1024 * 1024; // peak memory of one decode, 0 for no limit
+    quint64 maxPixels = 0; // source images with more pixels than this are skipped, 0 for no limit
+
+    bool operator!=(const DecodeLimits &b) const
+    {
+        return maxBytes != b.maxBytes || maxPixels != b.maxPixels;
+    }
+};
+
+// decodes the image behind reader at decodeSize (never larger than the source) within the limits.
+// JPEGs use DCT scaling so they never exist at full size. PNGs and TIFFs that would blow the byte
+// cap are streamed through a box filter a few rows at a time, so memory follows the output size,
+// with 16 bit samples reduced to 8 bit as they are read. Anything else over the caps is logged
+// and a null image returned, so the caller can skip it. Formats that can't tell their size without
+// decoding are only decoded when the file itself is within the byte cap, and dropped afterwards
+// if the result is over either cap.
+QImage DecodeImage(QImageReader &reader, const QSize &decodeSize, const DecodeLimits &limits);
+
+// whether an already decoded image is within the limits
+bool FitsDecodeLimits(const QImage &image, const DecodeLimits &limits);
+
+#endif // IMAGEDECODER_H
@@ -0,0 +1,249 @@
+#include "imagefilters.h"
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SLIDE_NEON
+#endif
+
+// a running sum of the four 8 bit channels of a 32 bit pixel, one 32 bit lane per channel
+#if defined(__SSE2__)
+typedef __m128i PixelSum;
+typedef __m128 PixelScale;
+
+static inline PixelSum loadPixel(quint32 pixel)
+{
+  const __m128i zero = _mm_setzero_si128();
+  return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)pixel), zero), zero);
+}
+static inline PixelSum zeroSum() { return _mm_setzero_si128(); }
+static inline PixelSum addPixel(PixelSum a, PixelSum b) { return _mm_add_epi32(a, b); }
+static inline PixelSum subPixel(PixelSum a, PixelSum b) { return _mm_sub_epi32(a, b); }
+static inline PixelScale makeScale(float scale) { return _mm_set1_ps(scale); }
+static inline quint32 storePixel(PixelSum sum, PixelScale scale)
+{
+  __m128i value = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), scale));
+  value = _mm_packs_epi32(value, value);
+  value = _mm_packus_epi16(value, value);
+  return (quint32)_mm_cvtsi128_si32(value);
+}
+#elif defined(SLIDE_NEON)
+typedef uint32x4_t PixelSum;
+typedef float32x4_t PixelScale;
+
+static inline PixelSum loadPixel(quint32 pixel)
+{
+  const uint16x8_t wide = vmovl_u8(vcreate_u8(pixel));
+  return vmovl_u16(vget_low_u16(wide));
+}
+static inline PixelSum zeroSum() { return vdupq_n_u32(0); }
+static inline PixelSum addPixel(PixelSum a, PixelSum b) { return vaddq_u32(a, b); }
+static inline PixelSum subPixel(PixelSum a, PixelSum b) { return vsubq_u32(a, b); }
+static inline PixelScale makeScale(float scale) { return vdupq_n_f32(scale); }
+static inline quint32 storePixel(PixelSum sum, PixelScale scale)
+{
+  const float32x4_t value = vaddq_f32(vmulq_f32(vcvtq_f32_u32(sum), scale), vdupq_n_f32(0.5f));
+  const uint16x4_t narrow = vmovn_u32(vcvtq_u32_f32(value));
+  const uint8x8_t bytes = vmovn_u16(vcombine_u16(narrow, narrow));
+  return vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+}
+#else
+struct PixelSum { quint32 channel[4]; };
+typedef float PixelScale;
+
+static inline PixelSum loadPixel(quint32 pixel)
+{
+  PixelSum sum;
+  for (int c = 0; c < 4; ++c)
+    sum.channel[c] = (pixel >> (c * 8)) & 0xff;
+  return sum;
+}
+static inline PixelSum zeroSum() { return PixelSum{{0, 0, 0, 0}}; }
+static inline PixelSum addPixel(PixelSum a, PixelSum b)
+{
+  for (int c = 0; c < 4; ++c)
+    a.channel[c] += b.channel[c];
+  return a;
+}
+static inline PixelSum subPixel(PixelSum a, PixelSum b)
+{
+  for (int c = 0; c < 4; ++c)
+    a.channel[c] -= b.channel[c];
+  return a;
+}
+static inline PixelScale makeScale(float scale) { return scale; }
+static inline quint32 storePixel(PixelSum sum, PixelScale scale)
+{
+  quint32 pixel = 0;
+  for (int c = 0; c < 4; ++c)
+    pixel |= std::min(255u, (quint32)(sum.channel[c] * scale + 0.5f)) << (c * 8);
+  return pixel;
+}
+#endif
+
+// box blur `count` pixels spaced `stride` apart from src into dst, edges are clamped
+static void boxBlurLine(const quint32 *src, quint32 *dst, int count, int stride, int radius)
+{
+  const PixelScale scale = makeScale(1.0f / (2 * radius + 1));
+  const int last = count - 1;
+  PixelSum sum = zeroSum();
+  for (int i = -radius; i <= radius; ++i)
+  {
+    sum = addPixel(sum, loadPixel(src[std::min(std::max(i, 0), last) * stride]));
+  }
+  for (int i = 0; i < count; ++i)
+  {
+    dst[i * stride] = storePixel(sum, scale);
+    const quint32 entering = src[std::min(i + radius + 1, last) * stride];
+    const quint32 leaving = src[std::max(i - radius, 0) * stride];
+    sum = subPixel(addPixel(sum, loadPixel(entering)), loadPixel(leaving));
+  }
+}
+
+// sizes of three box filters whose combination approximates a gaussian of the given sigma
+static void boxRadiiForGaussian(qreal sigma, int radii[3])
+{
+  const int passes = 3;
+  const qreal idealWidth = std::sqrt(12 * sigma * sigma / passes + 1);
+  int lowerWidth = (int)std::floor(idealWidth);
+  if (lowerWidth % 2 == 0)
+    --lowerWidth;
+  const int upperWidth = lowerWidth + 2;
+  const qreal idealLower = (12 * sigma * sigma - passes * lowerWidth * lowerWidth - 4 * passes * lowerWidth - 3 * passes) / (-4 * lowerWidth - 4);
+  const int lowerCount = (int)std::round(idealLower);
+  for (int i = 0; i < passes; ++i)
+  {
+    radii[i] = ((i < lowerCount ? lowerWidth : upperWidth) - 1) / 2;
+  }
+}
+
+static void boxBlur(QImage &image, qreal sigma)
+{
+  int radii[3];
+  boxRadiiForGaussian(sigma, radii);
+  const int width = image.width();
+  const int height = image.height();
+  const int stride = image.bytesPerLine() / 4;
+  quint32 *pixels = reinterpret_cast<quint32*>(image.bits());
+
+  QVector<quint32> line(std::max(width, height));
+  for (int radius : radii)
+  {
+    if (radius <= 0)
+      continue;
+    // rows, then columns; box blurs are separable
+    for (int y = 0; y < height; ++y)
+    {
+      quint32 *row = pixels + y * stride;
+      std::copy(row, row + width, line.data());
+      boxBlurLine(line.constData(), row, width, 1, radius);
+    }
+    for (int x = 0; x < width; ++x)
+    {
+      quint32 *column = pixels + x;
+      for (int y = 0; y < height; ++y)
+        line[y] = column[y * stride];
+      boxBlurLine(line.constData(), column, height, stride, radius);
+    }
+  }
+}
+
+void BlurImage(QImage &image, qreal radius, int downscale)
+{
+  if (radius <= 0 || image.isNull())
+  {
+    return;
+  }
+
+  // QGraphicsBlurEffect halves the image for radius >= 4 and runs an exponential blur of
+  // radius/2 on it, which works out to a gaussian sigma of about 0.615 * radius + 1.2
+  const qreal sigma = radius < 4 ? 0.615 * (radius + 1) : 0.615 * radius + 1.23;
+
+  // don't shrink so far that the blur spans less than a couple of pixels, it would look blocky
+  while (downscale > 1 && sigma / downscale < 2)
+  {
+    downscale /= 2;
+  }
+
+  if (image.format() != QImage::Format_ARGB32_Premultiplied && image.format() != QImage::Format_RGB32)
+  {
+    image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  }
+
+  if (downscale <= 1)
+  {
+    boxBlur(image, sigma);
+    return;
+  }
+
+  const QSize fullSize = image.size();
+  QImage small = image.scaled(std::max(1, fullSize.width() / downscale), std::max(1, fullSize.height() / downscale),
+                              Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+  boxBlur(small, sigma / downscale);
+  image = small.scaled(fullSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+// blend `count` pixels a byte at a time, for whatever the vector loops leave over
+static inline void blendBytes(const uchar *from, const uchar *to, uchar *out, int count, int alpha)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    out[i] = (uchar)((from[i] * (128 - alpha) + to[i] * alpha + 64) >> 7);
+  }
+}
+
+static void blendLine(const quint32 *from, const quint32 *to, quint32 *out, int count, int alpha)
+{
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i toWeight = _mm_set1_epi16((short)alpha);
+  const __m128i fromWeight = _mm_set1_epi16((short)(128 - alpha));
+  const __m128i bias = _mm_set1_epi16(64);
+  for (; x + 4 <= count; x += 4)
+  {
+    const __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + x));
+    const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + x));
+    __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(f, zero), fromWeight),
+                                _mm_mullo_epi16(_mm_unpacklo_epi8(t, zero), toWeight));
+    __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(f, zero), fromWeight),
+                                 _mm_mullo_epi16(_mm_unpackhi_epi8(t, zero), toWeight));
+    low = _mm_srli_epi16(_mm_add_epi16(low, bias), 7);
+    high = _mm_srli_epi16(_mm_add_epi16(high, bias), 7);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(low, high));
+  }
+#elif defined(SLIDE_NEON)
+  const uint8x8_t toWeight = vdup_n_u8((uint8_t)alpha);
+  const uint8x8_t fromWeight = vdup_n_u8((uint8_t)(128 - alpha));
+  for (; x + 4 <= count; x += 4)
+  {
+    const uint8x16_t f = vld1q_u8(reinterpret_cast<const uint8_t*>(from + x));
+    const uint8x16_t t = vld1q_u8(reinterpret_cast<const uint8_t*>(to + x));
+    const uint16x8_t low = vmlal_u8(vmull_u8(vget_low_u8(f), fromWeight), vget_low_u8(t), toWeight);
+    const uint16x8_t high = vmlal_u8(vmull_u8(vget_high_u8(f), fromWeight), vget_high_u8(t), toWeight);
+    vst1q_u8(reinterpret_cast<uint8_t*>(out + x), vcombine_u8(vrshrn_n_u16(low, 7), vrshrn_n_u16(high, 7)));
+  }
+#endif
+  blendBytes(reinterpret_cast<const uchar*>(from + x), reinterpret_cast<const uchar*>(to + x),
+             reinterpret_cast<uchar*>(out + x), (count - x) * 4, alpha);
+}
+
+void BlendImages(const QImage &from, const QImage &to, QImage &out, int alpha)
+{
+  if (from.size() != to.size() || from.size() != out.size() ||
+      from.depth() != 32 || to.depth() != 32 || out.depth() != 32)
+  {
+    return;
+  }
+  alpha = std::min(std::max(alpha, 0), 128);
+  const int width = out.width();
+  for (int y = 0; y < out.height(); ++y)
+  {
+    blendLine(reinterpret_cast<const quint32*>(from.constScanLine(y)), reinterpret_cast<const quint32*>(to.constScanLine(y)),
+              reinterpret_cast<quint32*>(out.scanLine(y)), width, alpha);
+  }
+}
@@ -0,0 +1,16 @@
+#ifndef IMAGEFILTERS_H
+#define IMAGEFILTERS_H
+
+#include <QImage>
+
+// blurs the image in place, radius follows the QGraphicsBlurEffect blurRadius semantics.
+// Three separable box blur passes approximate the gaussian, using SSE2/NEON when available.
+// With downscale > 1 the blur runs at 1/downscale resolution and is scaled back up,
+// which is close to free visually since the result is low frequency anyway.
+void BlurImage(QImage &image, qreal radius, int downscale = 1);
+
+// crossfades from towards to, alpha runs from 0 (all from) to 128 (all to).
+// All three images must be the same size and 32 bits per pixel, out is written in place.
+void BlendImages(const QImage &from, const QImage &to, QImage &out, int alpha);
+
+#endif // IMAGEFILTERS_H
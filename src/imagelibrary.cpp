@@ -0,0 +1,376 @@
+#include "imagelibrary.h"
+#include "pathtraverser.h"
+#include "logger.h"
+#include "metrics.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSet>
+#include <algorithm>
+
+// removed images and folders are left as tombstones until there are this many, or a quarter
+// as many as there are images; compacting renumbers everything and has every view rebuild
+static const quint32 minimumDeadIds = 1024;
+
+ImageLibrary::ImageLibrary(const std::string &path, bool recursiveIn):
+  rootPath(QDir(QString::fromStdString(path)).absolutePath()),
+  recursive(recursiveIn)
+{
+  connect(&watcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+  {
+    StageTimer timer(Metrics::scan);
+    scanDirectory(rootPath);
+  }
+  Log("Library ", rootPath.toStdString(), ": ", store.liveImageCount(), " images in ", directoryIds.size(), " folders");
+}
+
+ImageLibrary::~ImageLibrary()
+{
+}
+
+QStringList ImageLibrary::listImages(const QString &directoryPath) const
+{
+  // file names only, sorted so a scan of the same tree always hands out the same ids
+  return QDir(directoryPath).entryList(PathTraverser::getImageFormats(), QDir::Files, QDir::Name);
+}
+
+void ImageLibrary::scanDirectory(const QString &directoryPath)
+{
+  QStringList files = listImages(directoryPath);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const QFileInfo info(directoryPath);
+    const quint32 parent = directoryPath == rootPath ? PathStore::invalidId : directoryIds.value(info.path(), PathStore::invalidId);
+    const quint32 directory = store.addDirectory(parent, parent == PathStore::invalidId ? directoryPath : info.fileName());
+    directoryIds.insert(directoryPath, directory);
+    for (const QString &file : files)
+    {
+      store.addImage(directory, file);
+    }
+    ++generation;
+  }
+  if (!watcher.addPath(directoryPath))
+  {
+    Log("Unable to watch ", directoryPath.toStdString(), " for changes");
+  }
+
+  if (recursive)
+  {
+    // linked folders aren't followed, like the QDirIterator walk this replaced; one pointing
+    // back up the tree would otherwise be scanned forever under ever longer paths
+    QDir directory(directoryPath);
+    for (const QString &name : directory.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks))
+    {
+      const QString subdirectoryPath = directory.filePath(name);
+      bool known = false;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        known = directoryIds.contains(subdirectoryPath);
+      }
+      if (!known)
+      {
+        scanDirectory(subdirectoryPath);
+      }
+    }
+  }
+}
+
+void ImageLibrary::removeDirectory(const QString &directoryPath)
+{
+  const QString prefix = directoryPath + "/";
+  QStringList removed;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = directoryIds.begin(); it != directoryIds.end();)
+    {
+      if (it.key() == directoryPath || it.key().startsWith(prefix))
+      {
+        removed.append(it.key());
+        store.removeDirectory(it.value());
+        it = directoryIds.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    ++generation;
+    compactIfSparse();
+  }
+  if (!removed.isEmpty())
+  {
+    watcher.removePaths(removed);
+  }
+  Log("Library: folder removed ", directoryPath.toStdString());
+}
+
+void ImageLibrary::directoryChanged(const QString &directoryPath)
+{
+  StageTimer timer(Metrics::scan);
+  if (!QFileInfo(directoryPath).isDir())
+  {
+    removeDirectory(directoryPath);
+    return;
+  }
+
+  // only the changed folder is listed again, files added/removed/renamed become a delta
+  QStringList files = listImages(directoryPath);
+  int added = 0;
+  int removed = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const quint32 directory = directoryIds.value(directoryPath, PathStore::invalidId);
+    if (directory != PathStore::invalidId)
+    {
+      // unchanged images keep their ids, only the difference is applied to the store
+      QHash<QString, quint32> known;
+      const std::vector<quint32> &ids = store.imagesIn(directory);
+      known.reserve((int)ids.size());
+      for (quint32 id : ids)
+      {
+        known.insert(QString::fromUtf8(store.imageName(id)), id);
+      }
+      QSet<QString> current;
+      current.reserve(files.size());
+      for (const QString &file : files)
+      {
+        current.insert(file);
+        if (!known.contains(file))
+        {
+          store.addImage(directory, file);
+          ++added;
+        }
+      }
+      for (auto it = known.constBegin(); it != known.constEnd(); ++it)
+      {
+        if (!current.contains(it.key()))
+        {
+          store.removeImage(it.value());
+          ++removed;
+        }
+      }
+      if (added > 0 || removed > 0)
+      {
+        ++generation;
+      }
+      if (removed > 0)
+      {
+        compactIfSparse();
+      }
+    }
+  }
+  if (added > 0 || removed > 0)
+  {
+    Log("Library: ", directoryPath.toStdString(), " +", added, " -", removed);
+  }
+
+  if (recursive)
+  {
+    // pick up new subfolders and drop ones that were removed or renamed away
+    QDir directory(directoryPath);
+    QStringList subdirectories;
+    for (const QString &name : directory.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks))
+    {
+      subdirectories.append(directory.filePath(name));
+    }
+    QStringList vanished;
+    QStringList appeared;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      const QString prefix = directoryPath + "/";
+      for (auto it = directoryIds.constBegin(); it != directoryIds.constEnd(); ++it)
+      {
+        const QString &path = it.key();
+        if (path.startsWith(prefix) && path.indexOf('/', prefix.size()) < 0 && !subdirectories.contains(path))
+        {
+          vanished.append(path);
+        }
+      }
+      for (const QString &path : subdirectories)
+      {
+        if (!directoryIds.contains(path))
+        {
+          appeared.append(path);
+        }
+      }
+    }
+    for (const QString &path : vanished)
+    {
+      removeDirectory(path);
+    }
+    for (const QString &path : appeared)
+    {
+      scanDirectory(path);
+    }
+  }
+}
+
+void ImageLibrary::compactIfSparse()
+{
+  // called with the mutex held, right after removals
+  const quint32 dead = store.deadIdCount();
+  if (dead < std::max(minimumDeadIds, store.liveImageCount() / 4))
+  {
+    return;
+  }
+  const std::vector<quint32> directoryMap = store.compactIds();
+  for (auto it = directoryIds.begin(); it != directoryIds.end(); ++it)
+  {
+    it.value() = directoryMap[it.value()];
+  }
+  ++layout;
+  ++generation;
+  Log("Library ", rootPath.toStdString(), ": compacted ", dead, " removed ids");
+}
+
+QStringList ImageLibrary::getImages() const
+{
+  // builds every path, the selectors use getImageCount()/getImageAt() instead
+  std::lock_guard<std::mutex> lock(mutex);
+  QStringList images;
+  images.reserve((int)store.liveImageCount());
+  for (quint32 id = 0; id < store.imageIdCount(); ++id)
+  {
+    if (store.isLive(id))
+    {
+      images.append(QString::fromStdString(store.imagePath(id)));
+    }
+  }
+  return images;
+}
+
+int ImageLibrary::getImageCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return (int)store.liveImageCount();
+}
+
+std::string ImageLibrary::getImageAt(int index) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return store.imagePath((quint32)index);
+}
+
+quint64 ImageLibrary::getGeneration() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return generation;
+}
+
+quint64 ImageLibrary::getIdLayout() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return layout;
+}
+
+bool ImageLibrary::covers(const QString &path, bool recursiveIn) const
+{
+  if (path == rootPath)
+  {
+    return recursive || !recursiveIn;
+  }
+  return recursive && path.startsWith(rootPath + "/");
+}
+
+quint32 ImageLibrary::appendImagesIn(const std::string &folder, bool recursiveIn, quint32 firstId, quint64 &idLayout,
+                                     std::vector<quint32> &images, std::vector<qint8> &folderMatches) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (idLayout != layout)
+  {
+    // every id may name something else now
+    images.clear();
+    folderMatches.clear();
+    firstId = 0;
+    idLayout = layout;
+  }
+  const quint32 end = store.imageIdCount();
+  for (quint32 id = firstId; id < end; ++id)
+  {
+    if (!store.isLive(id))
+    {
+      continue;
+    }
+    const quint32 directory = store.imageDirectory(id);
+    if (directory >= folderMatches.size())
+    {
+      folderMatches.resize(directory + 1, -1);
+    }
+    if (folderMatches[directory] < 0)
+    {
+      // directory ids are only reused under a new layout, which starts over
+      const std::string path = store.directoryPath(directory);
+      const bool below = recursiveIn && path.size() > folder.size() && path[folder.size()] == '/' &&
+                         path.compare(0, folder.size(), folder) == 0;
+      folderMatches[directory] = path == folder || below;
+    }
+    if (folderMatches[directory] > 0)
+    {
+      images.push_back(id);
+    }
+  }
+  return end;
+}
+
+ImageLibraryView::ImageLibraryView(const std::shared_ptr<ImageLibrary> &libraryIn, const std::string &path, bool recursiveIn):
+  library(libraryIn),
+  folder(QDir(QString::fromStdString(path)).absolutePath().toStdString()),
+  recursive(recursiveIn)
+{
+}
+
+void ImageLibraryView::update() const
+{
+  // ids only grow, so only the ones added since last time need looking at
+  const quint64 generation = library->getGeneration();
+  if (generation == updatedGeneration)
+  {
+    return;
+  }
+  nextLibraryId = library->appendImagesIn(folder, recursive, nextLibraryId, libraryLayout, images, folderMatches);
+  updatedGeneration = generation;
+}
+
+QStringList ImageLibraryView::getImages() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  update();
+  QStringList paths;
+  for (quint32 id : images)
+  {
+    const std::string path = library->getImageAt((int)id);
+    if (!path.empty())
+    {
+      paths.append(QString::fromStdString(path));
+    }
+  }
+  return paths;
+}
+
+quint64 ImageLibraryView::getGeneration() const
+{
+  return library->getGeneration();
+}
+
+quint64 ImageLibraryView::getIdLayout() const
+{
+  // the view renumbers its images whenever the library does
+  return library->getIdLayout();
+}
+
+int ImageLibraryView::getImageCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  update();
+  return (int)images.size();
+}
+
+std::string ImageLibraryView::getImageAt(int index) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  update(); // never look up ids from before a compaction in the library as it is now
+  if (index < 0 || index >= (int)images.size())
+  {
+    return std::string();
+  }
+  return library->getImageAt((int)images[index]);
+}
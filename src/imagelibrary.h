@@ -0,0 +1,85 @@
+#ifndef IMAGELIBRARY_H
+#define IMAGELIBRARY_H
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QStringList>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "pathstore.h"
+
+// the images under a folder, scanned once and then kept current from file
+// system notifications (inotify on Linux) rather than rescanning the tree
+class ImageLibrary : public QObject
+{
+    Q_OBJECT
+public:
+    ImageLibrary(const std::string &path, bool recursive);
+    virtual ~ImageLibrary();
+    QStringList getImages() const;
+    quint64 getGeneration() const;
+    // changes when removed images are compacted away and ids are handed out again
+    quint64 getIdLayout() const;
+    int getImageCount() const; // live images
+    // images are addressed by their store id, ids of removed images give an empty path
+    std::string getImageAt(int index) const;
+    // whether every image of the folder (and below, when recursive) is in this library
+    bool covers(const QString &path, bool recursive) const;
+    // appends the live images with ids from firstId on that are in folder (and below it when recursive),
+    // folderMatches caches the answer per store directory. If the id layout is no longer idLayout,
+    // images and folderMatches are cleared and refilled from the first id, and idLayout updated.
+    // Returns the id to carry on from next time
+    quint32 appendImagesIn(const std::string &folder, bool recursive, quint32 firstId, quint64 &idLayout,
+                           std::vector<quint32> &images, std::vector<qint8> &folderMatches) const;
+
+private slots:
+    void directoryChanged(const QString &directoryPath);
+
+private:
+    void scanDirectory(const QString &directoryPath);
+    void removeDirectory(const QString &directoryPath);
+    void compactIfSparse();
+    QStringList listImages(const QString &directoryPath) const;
+
+    const QString rootPath;
+    const bool recursive;
+    QFileSystemWatcher watcher;
+    mutable std::mutex mutex;
+    PathStore store;
+    QHash<QString, quint32> directoryIds; // store directory of every absolute folder path
+    quint64 generation = 0;
+    quint64 layout = 0;
+};
+
+// the images of one folder of a library that may be shared with other folders, so schedule
+// entries inside the same tree don't each scan and hold it. Indexes are the view's own and
+// only ever grow, images removed from the library read back as empty paths, until the
+// library compacts its ids and the view is rebuilt under a new id layout.
+class ImageLibraryView
+{
+public:
+    ImageLibraryView(const std::shared_ptr<ImageLibrary> &library, const std::string &path, bool recursive);
+    QStringList getImages() const;
+    quint64 getGeneration() const;
+    quint64 getIdLayout() const;
+    int getImageCount() const;
+    std::string getImageAt(int index) const;
+
+private:
+    void update() const;
+
+    const std::shared_ptr<ImageLibrary> library;
+    const std::string folder;
+    const bool recursive;
+    mutable std::mutex mutex;
+    mutable std::vector<quint32> images; // library ids
+    mutable std::vector<qint8> folderMatches; // per library directory, -1 until checked
+    mutable quint32 nextLibraryId = 0;
+    mutable quint64 libraryLayout = 0;
+    mutable quint64 updatedGeneration = ~0ULL;
+};
+
+#endif // IMAGELIBRARY_H
@@ -0,0 +1,240 @@
+#include "imagelistfile.h"
+#include "logger.h"
+#include <QFileInfo>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool isBlank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+ImageListFile::ImageListFile(const std::string &path):
+  listPath(QFileInfo(QString::fromStdString(path)).absoluteFilePath()),
+  baseDirectory(QFileInfo(listPath).absolutePath().toStdString())
+{
+  connect(&watcher, SIGNAL(fileChanged(QString)), this, SLOT(fileChanged(QString)));
+  connect(&watcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+  // the folder too, so a list that is replaced by renaming a new one over it is picked up again
+  watcher.addPath(QFileInfo(listPath).absolutePath());
+  if (!watcher.addPath(listPath))
+  {
+    Log("Unable to watch ", listPath.toStdString(), " for changes");
+  }
+  refresh();
+  Log("Image list ", listPath.toStdString(), ": ", getImageCount(), " images");
+}
+
+ImageListFile::~ImageListFile()
+{
+}
+
+bool ImageListFile::reopen()
+{
+  file.close();
+  file.setFileName(listPath);
+  return file.open(QIODevice::ReadOnly);
+}
+
+qint64 ImageListFile::readAt(qint64 offset, char *buffer, qint64 length) const
+{
+  qint64 done = 0;
+  while (done < length)
+  {
+    const ssize_t count = ::pread(file.handle(), buffer + done, length - done, offset + done);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      break; // the end of the file, wherever it is now
+    done += count;
+  }
+  return done;
+}
+
+void ImageListFile::indexFrom(qint64 offset)
+{
+  static const qint64 chunkSize = 64 * 1024;
+  std::vector<char> chunk(chunkSize);
+  partialLine = false;
+  qint64 lineStart = offset;
+  qint64 entryStart = -1; // where the current line's image starts, if it is one
+  bool lineDecided = false; // seen the first non blank character of the current line
+  qint64 position = offset;
+  while (position < fileSize)
+  {
+    const qint64 length = readAt(position, chunk.data(), std::min(chunkSize, fileSize - position));
+    if (length <= 0)
+    {
+      break; // shrunk since we looked, the watcher will tell us
+    }
+    const char *data = chunk.data();
+    qint64 at = 0;
+    while (at < length)
+    {
+      const char *newline = static_cast<const char*>(memchr(data + at, '\n', length - at));
+      const qint64 end = newline != nullptr ? newline - data : length;
+      for (; !lineDecided && at < end; ++at)
+      {
+        if (!isBlank(data[at]))
+        {
+          lineDecided = true;
+          // blank lines and m3u directives (#EXTM3U, #EXTINF...) aren't images
+          if (data[at] != '#')
+            entryStart = position + at;
+        }
+      }
+      if (newline == nullptr)
+        break;
+      if (entryStart >= 0)
+      {
+        lineOffsets.push_back(entryStart);
+      }
+      lineStart = position + end + 1;
+      entryStart = -1;
+      lineDecided = false;
+      at = end + 1;
+    }
+    position += length;
+  }
+  if (entryStart >= 0)
+  {
+    // the writer may still be part way through this line, look at it again once it grows
+    lineOffsets.push_back(entryStart);
+    partialLine = true;
+  }
+  indexedBytes = lineStart;
+}
+
+void ImageListFile::reindex()
+{
+  lineOffsets.clear();
+  indexFrom(0);
+  ++layout;
+}
+
+void ImageListFile::refresh()
+{
+  struct stat info;
+  if (::stat(QFile::encodeName(listPath).constData(), &info) != 0)
+  {
+    // keep showing what we have, the list is most likely being replaced
+    Log("Image list ", listPath.toStdString(), " is not readable");
+    return;
+  }
+  const quint64 id = (quint64)info.st_ino;
+  const qint64 size = (qint64)info.st_size;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const size_t previousCount = lineOffsets.size();
+  const bool replaced = id != fileId || size < indexedBytes;
+  if (!replaced && size == fileSize)
+  {
+    return; // touched, but nothing new
+  }
+  if (replaced && !reopen())
+  {
+    Log("Unable to open image list ", listPath.toStdString());
+    lineOffsets.clear();
+    indexedBytes = 0;
+    fileSize = 0;
+    fileId = 0;
+    partialLine = false;
+    ++generation;
+    ++layout;
+    return;
+  }
+  fileId = id;
+  fileSize = size;
+
+  // only appends are indexed incrementally, anything that rewrote the indexed part
+  // (a new file, a shorter one, or one whose last indexed line no longer ends where it did)
+  // starts over
+  char lastIndexed = '\n';
+  if (replaced || (indexedBytes > 0 && (readAt(indexedBytes - 1, &lastIndexed, 1) != 1 || lastIndexed != '\n')))
+  {
+    reindex();
+    Log("Image list ", listPath.toStdString(), " re-read: ", lineOffsets.size(), " images");
+  }
+  else
+  {
+    if (partialLine)
+    {
+      lineOffsets.pop_back();
+    }
+    indexFrom(indexedBytes);
+    if (lineOffsets.size() != previousCount)
+    {
+      Log("Image list ", listPath.toStdString(), " +", (qint64)lineOffsets.size() - (qint64)previousCount);
+    }
+  }
+  ++generation;
+}
+
+void ImageListFile::fileChanged(const QString &filePath)
+{
+  Q_UNUSED(filePath);
+  // renaming over or deleting a watched file drops it from the watcher
+  if (!watcher.files().contains(listPath) && QFileInfo::exists(listPath))
+  {
+    watcher.addPath(listPath);
+  }
+  refresh();
+}
+
+void ImageListFile::directoryChanged(const QString &directoryPath)
+{
+  Q_UNUSED(directoryPath);
+  if (!watcher.files().contains(listPath) && QFileInfo::exists(listPath))
+  {
+    watcher.addPath(listPath);
+    refresh();
+  }
+}
+
+int ImageListFile::getImageCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return (int)lineOffsets.size();
+}
+
+std::string ImageListFile::getImageAt(int index) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (index < 0 || index >= (int)lineOffsets.size())
+  {
+    return std::string();
+  }
+  // the line ends before the next entry starts, the last one at most at the end of the file
+  const qint64 start = lineOffsets[index];
+  const qint64 limit = index + 1 < (int)lineOffsets.size() ? lineOffsets[index + 1] : fileSize;
+  std::string entry(std::max((qint64)0, limit - start), '\0');
+  entry.resize(readAt(start, &entry[0], (qint64)entry.size()));
+  const size_t newline = entry.find('\n');
+  if (newline != std::string::npos)
+  {
+    entry.resize(newline);
+  }
+  while (!entry.empty() && isBlank(entry.back()))
+    entry.pop_back();
+  if (!entry.empty() && entry[0] != '/')
+  {
+    // playlists usually hold paths relative to themselves
+    return baseDirectory + "/" + entry;
+  }
+  return entry;
+}
+
+quint64 ImageListFile::getGeneration() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return generation;
+}
+
+quint64 ImageListFile::getLayout() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return layout;
+}
@@ -0,0 +1,54 @@
+#ifndef IMAGELISTFILE_H
+#define IMAGELISTFILE_H
+
+#include <QObject>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QString>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// a newline delimited (optionally m3u style) list of images indexed by line offsets, so a
+// playlist of any size costs 8 bytes an entry instead of a string each. Entries are read
+// from the file with pread when they are asked for rather than through a mapping, as a list
+// truncated or rewritten in place under a mapping faults the whole process (SIGBUS); a read
+// past the end just comes back short. Appends are indexed incrementally as the file changes,
+// anything else re-indexes it.
+class ImageListFile : public QObject
+{
+    Q_OBJECT
+public:
+    ImageListFile(const std::string &path);
+    virtual ~ImageListFile();
+    int getImageCount() const;
+    std::string getImageAt(int index) const;
+    quint64 getGeneration() const;
+    quint64 getLayout() const; // changes when the list is re-read from the top rather than appended to
+
+private slots:
+    void fileChanged(const QString &filePath);
+    void directoryChanged(const QString &directoryPath);
+
+private:
+    void refresh();
+    void reindex();
+    bool reopen();
+    void indexFrom(qint64 offset);
+    qint64 readAt(qint64 offset, char *buffer, qint64 length) const;
+
+    const QString listPath;
+    const std::string baseDirectory; // relative entries are resolved against the list's folder
+    QFileSystemWatcher watcher;
+    mutable std::mutex mutex;
+    QFile file;
+    qint64 fileSize = 0; // as of the last refresh, everything indexed lies before it
+    quint64 fileId = 0; // inode, a different one means the list was replaced rather than appended to
+    std::vector<qint64> lineOffsets; // start of every entry
+    qint64 indexedBytes = 0; // everything before this ends in a newline and is indexed
+    bool partialLine = false; // the last entry has no newline yet and is indexed again next time
+    quint64 generation = 0;
+    quint64 layout = 0;
+};
+
+#endif // IMAGELISTFILE_H
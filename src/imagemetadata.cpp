@@ -0,0 +1,176 @@
+#include "imagemetadata.h"
+#include "metadataindex.h"
+#include "metrics.h"
+#include <QByteArray>
+#include <QFile>
+#include <libexif/exif-data.h>
+
+static int ReadExifTag(ExifData* exifData, ExifTag tag, bool shortRead = false)
+{
+  int value = -1;
+  ExifByteOrder byteOrder = exif_data_get_byte_order(exifData);
+  ExifEntry *exifEntry = exif_data_get_entry(exifData, tag);
+
+  if (exifEntry)
+  {
+    if (shortRead)
+    {
+      return exif_get_short(exifEntry->data, byteOrder);
+    }
+    
+    return exif_get_long(exifEntry->data, byteOrder);
+  }
+  return value;
+}
+
+static QString ReadExifString(ExifData* exifData, ExifTag tag)
+{
+  ExifEntry *exifEntry = exif_data_get_entry(exifData, tag);
+  if (!exifEntry)
+  {
+    return QString();
+  }
+  char buf[2048];
+  return QString::fromUtf8(exif_entry_get_value(exifEntry, buf, sizeof(buf))).trimmed();
+}
+
+// walks the jpeg markers up to the start of the image data looking for the APP1 Exif segment.
+// segmentOffset is where the segment payload ("Exif\0\0" then the TIFF header) starts in the file
+static bool readJpegExifSegment(QFile &file, QByteArray &segment, qint64 &segmentOffset)
+{
+  uchar marker[4];
+  for (;;)
+  {
+    if (file.read(reinterpret_cast<char*>(marker), 4) != 4 || marker[0] != 0xFF)
+    {
+      return false;
+    }
+    const uchar type = marker[1];
+    if (type == 0xDA || type == 0xD9)
+    {
+      return false; // start of scan, exif always comes before it
+    }
+    const int length = (marker[2] << 8) | marker[3];
+    if (length < 2)
+    {
+      return false;
+    }
+    if (type == 0xE1)
+    {
+      segmentOffset = file.pos();
+      segment = file.read(length - 2);
+      if (segment.size() == length - 2 && segment.startsWith(QByteArray("Exif\0\0", 6)))
+      {
+        return true;
+      }
+      // some other APP1 (XMP), keep going
+    }
+    else if (!file.seek(file.pos() + length - 2))
+    {
+      return false;
+    }
+  }
+}
+
+// libexif loads the thumbnail but doesn't say where it is, so read the IFD1 pointers ourselves
+static void findThumbnail(const QByteArray &segment, qint64 segmentOffset, ImageMetadata &metadata)
+{
+  const int headerSize = 6; // "Exif\0\0"
+  const uchar *tiff = reinterpret_cast<const uchar*>(segment.constData()) + headerSize;
+  const quint64 size = segment.size() - headerSize;
+  if (size < 8)
+  {
+    return;
+  }
+  const bool bigEndian = tiff[0] == 'M';
+  auto read16 = [&](quint64 offset) -> quint32 {
+    return bigEndian ? (tiff[offset] << 8) | tiff[offset + 1] : tiff[offset] | (tiff[offset + 1] << 8);
+  };
+  auto read32 = [&](quint64 offset) -> quint32 {
+    return bigEndian ? (read16(offset) << 16) | read16(offset + 2) : read16(offset) | (read16(offset + 2) << 16);
+  };
+
+  const quint64 ifd0 = read32(4);
+  if (ifd0 + 2 > size)
+  {
+    return;
+  }
+  const quint64 nextIfdPointer = ifd0 + 2 + read16(ifd0) * 12;
+  if (nextIfdPointer + 4 > size)
+  {
+    return;
+  }
+  const quint64 ifd1 = read32(nextIfdPointer);
+  if (ifd1 == 0 || ifd1 + 2 > size)
+  {
+    return;
+  }
+
+  quint64 thumbnailOffset = 0;
+  quint64 thumbnailLength = 0;
+  const quint32 entries = read16(ifd1);
+  for (quint32 i = 0; i < entries; ++i)
+  {
+    const quint64 entry = ifd1 + 2 + i * 12;
+    if (entry + 12 > size)
+    {
+      break;
+    }
+    const quint32 tag = read16(entry);
+    if (tag == EXIF_TAG_JPEG_INTERCHANGE_FORMAT)
+    {
+      thumbnailOffset = read32(entry + 8);
+    }
+    else if (tag == EXIF_TAG_JPEG_INTERCHANGE_FORMAT_LENGTH)
+    {
+      thumbnailLength = read32(entry + 8);
+    }
+  }
+  if (thumbnailOffset > 0 && thumbnailLength > 0 && thumbnailOffset + thumbnailLength <= size)
+  {
+    metadata.thumbnailOffset = segmentOffset + headerSize + thumbnailOffset;
+    metadata.thumbnailLength = thumbnailLength;
+  }
+}
+
+bool ReadImageMetadata(const std::string &fileName, ImageMetadata &metadata)
+{
+  StageTimer timer(Metrics::exif);
+  if (!MetadataIndex::statFile(fileName, metadata))
+  {
+    return false;
+  }
+
+  ExifData *exifData = nullptr;
+  QFile file(QString::fromStdString(fileName));
+  if (file.open(QIODevice::ReadOnly) && file.peek(2) == QByteArray("\xFF\xD8", 2))
+  {
+    file.seek(2);
+    QByteArray segment;
+    qint64 segmentOffset = 0;
+    if (readJpegExifSegment(file, segment, segmentOffset))
+    {
+      exifData = exif_data_new_from_data(reinterpret_cast<const unsigned char*>(segment.constData()), segment.size());
+      findThumbnail(segment, segmentOffset, metadata);
+    }
+  }
+  else
+  {
+    // not a jpeg, let libexif look for whatever it understands
+    exifData = exif_data_new_from_file(fileName.c_str());
+  }
+
+  if (exifData)
+  {
+    metadata.orientation = ReadExifTag(exifData, EXIF_TAG_ORIENTATION, true);
+    const QString dateTime = ReadExifString(exifData, EXIF_TAG_DATE_TIME_ORIGINAL);
+    if (!dateTime.isEmpty())
+    {
+      metadata.captureTime = MetadataIndex::captureTimeFromExif(dateTime);
+    }
+    metadata.cameraMake = ReadExifString(exifData, EXIF_TAG_MAKE);
+    metadata.cameraModel = ReadExifString(exifData, EXIF_TAG_MODEL);
+    exif_data_free(exifData);
+  }
+  return true;
+}
@@ -0,0 +1,27 @@
+#ifndef IMAGEMETADATA_H
+#define IMAGEMETADATA_H
+
+#include <QString>
+#include <QtGlobal>
+#include <string>
+
+// what we know about an image file without having to open it again
+struct ImageMetadata
+{
+    qint64 fileSize = 0;
+    qint64 modifiedTime = 0; // msecs since epoch
+    int width = -1; // as stored in the file, before exif rotation
+    int height = -1;
+    int orientation = -1; // exif orientation tag, -1 if missing
+    qint64 captureTime = -1; // exif DateTimeOriginal wall clock time as msecs since epoch, -1 if missing
+    QString cameraMake;
+    QString cameraModel;
+    qint64 thumbnailOffset = -1; // file offset of the embedded exif jpeg thumbnail, -1 if there is none
+    qint64 thumbnailLength = 0;
+};
+
+// fills everything but the dimensions from one stat and one pass over the exif data.
+// For jpegs only the APP1 segment is read, not the whole file.
+bool ReadImageMetadata(const std::string &fileName, ImageMetadata &metadata);
+
+#endif // IMAGEMETADATA_H
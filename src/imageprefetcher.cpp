@@ -0,0 +1,258 @@
+#include "imageprefetcher.h"
+#include "logger.h"
+#include "metrics.h"
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+
+// images that fail to decode (corrupt, over the decode limits) are skipped, up to this many in a row.
+// After that the job gives up and its turn is skipped, the next job tries again; the frame is
+// never composed on the GUI thread instead. A whole queue of jobs giving up in a row waits for
+// the next tick, like a selection that finds nothing
+static const int maxRenderAttempts = 5;
+
+class PrefetchJob : public QRunnable
+{
+public:
+    PrefetchJob(ImagePrefetcher *prefetcherIn, quint64 generationIn, const ImageDisplayOptions &optionsIn, const RenderSettings &settingsIn):
+      prefetcher(prefetcherIn),
+      generation(generationIn),
+      options(optionsIn),
+      settings(settingsIn)
+    {
+    }
+
+    void run() override
+    {
+      prefetcher->runJob(generation, options, settings);
+    }
+
+private:
+    ImagePrefetcher *prefetcher;
+    quint64 generation;
+    ImageDisplayOptions options;
+    RenderSettings settings;
+};
+
+ImagePrefetcher::ImagePrefetcher(SelectFunction selectImageIn, QObject *parent):
+    QObject(parent),
+    selectImage(selectImageIn)
+{
+  pool.setMaxThreadCount(std::max(1, std::min((int)depth, QThread::idealThreadCount())));
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+  pool.clear();
+  pool.waitForDone();
+}
+
+void ImagePrefetcher::setDepth(unsigned int depthIn)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    depth = depthIn;
+  }
+  pool.setMaxThreadCount(std::max(1, std::min((int)depthIn, QThread::idealThreadCount())));
+}
+
+void ImagePrefetcher::setMemoryBudget(unsigned int megabytes)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  memoryBudget = (size_t)megabytes * 1024 * 1024;
+}
+
+void ImagePrefetcher::setRotationTime(unsigned int msec)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  rotationMsec = msec;
+}
+
+bool ImagePrefetcher::isEnabled() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return depth > 0;
+}
+
+void ImagePrefetcher::setContext(const ImageDisplayOptions &optionsIn, const RenderSettings &settingsIn)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  options = optionsIn;
+  settings = settingsIn;
+  hasContext = true;
+}
+
+unsigned int ImagePrefetcher::maxQueuedFrames() const
+{
+  // always allow at least one frame in flight, otherwise prefetching would never happen
+  const size_t frameBytes = std::max(1, settings.screenSize.width() * settings.screenSize.height() * 4);
+  const size_t framesInBudget = std::max((size_t)1, memoryBudget / frameBytes);
+  return (unsigned int)std::min((size_t)depth, framesInBudget);
+}
+
+QDateTime ImagePrefetcher::displayTimeOf(quint64 sequence) const
+{
+  // frames go on screen one rotation apart after the next one
+  const QDateTime now = QDateTime::currentDateTime();
+  if (!nextDisplayTime.isValid())
+  {
+    return now;
+  }
+  return std::max(now, nextDisplayTime.addMSecs((qint64)(sequence - nextDeliverSequence) * rotationMsec));
+}
+
+void ImagePrefetcher::fill()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (depth == 0 || !hasContext || stalled)
+  {
+    return;
+  }
+
+  const unsigned int maxFrames = maxQueuedFrames();
+  while (inFlight + finished.size() < maxFrames)
+  {
+    ++inFlight;
+    pool.start(new PrefetchJob(this, generation, options, settings));
+  }
+}
+
+void ImagePrefetcher::runJob(quint64 jobGeneration, ImageDisplayOptions jobOptions, RenderSettings jobSettings)
+{
+  PreparedFrame prepared;
+  prepared.settings = jobSettings;
+  quint64 sequence = 0;
+  QDateTime displayTime;
+  bool current = true;
+  for (int attempt = 0; current && attempt < maxRenderAttempts; ++attempt)
+  {
+    {
+      std::lock_guard<std::mutex> selectLock(selectMutex);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = jobGeneration == generation;
+        if (attempt == 0)
+        {
+          // selections are serialised, so this job gets the next sequence number
+          displayTime = displayTimeOf(nextSequence);
+        }
+      }
+      if (current)
+      {
+        prepared.imageDetails = selectImage(jobOptions, displayTime);
+        std::lock_guard<std::mutex> lock(mutex);
+        current = jobGeneration == generation;
+        if (current && attempt == 0)
+        {
+          sequence = nextSequence++;
+        }
+      }
+    }
+
+    if (!current || prepared.imageDetails.filename.empty())
+    {
+      break;
+    }
+    ImageRenderer renderer(jobSettings);
+    prepared.frame = renderer.render(prepared.imageDetails);
+    prepared.imageDetails.image = QImage(); // the composed frame is all we need to hold on to
+    if (!prepared.frame.isNull())
+    {
+      break;
+    }
+    Log("prefetch: skipping ", prepared.imageDetails.filename, ", it couldn't be composed");
+  }
+  prepared.failed = current && !prepared.imageDetails.filename.empty() && prepared.frame.isNull();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    --inFlight;
+    if (current && jobGeneration == generation)
+    {
+      if (!prepared.failed)
+      {
+        failedInRow = 0;
+      }
+      else if (++failedInRow >= maxQueuedFrames())
+      {
+        // nothing composes (an unreadable library, a missing mount), so rather than requeueing
+        // straight away this turn reports that nothing was found and the next tick tries again
+        Log("prefetch: ", failedInRow, " jobs in a row couldn't compose an image, waiting for the next switch");
+        prepared.failed = false;
+        prepared.imageDetails = ImageDetails();
+        failedInRow = 0;
+      }
+      if (prepared.imageDetails.filename.empty())
+      {
+        stalled = true;
+      }
+      finished[sequence] = prepared;
+      Metrics::prefetchQueued.set(finished.size());
+    }
+  }
+  QMetaObject::invokeMethod(this, "jobFinished", Qt::QueuedConnection);
+}
+
+void ImagePrefetcher::jobFinished()
+{
+  bool available = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    available = finished.count(nextDeliverSequence) > 0;
+  }
+  if (available)
+  {
+    emit frameAvailable();
+  }
+  fill();
+}
+
+bool ImagePrefetcher::takeFrame(PreparedFrame &frame)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = finished.find(nextDeliverSequence);
+  // jobs that ran out of attempts give up their turn, fill() starts new ones in their place
+  while (it != finished.end() && it->second.failed)
+  {
+    finished.erase(it);
+    it = finished.find(++nextDeliverSequence);
+  }
+  Metrics::prefetchQueued.set(finished.size());
+  if (it == finished.end())
+  {
+    return false;
+  }
+  frame = it->second;
+  finished.erase(it);
+  Metrics::prefetchQueued.set(finished.size());
+  ++nextDeliverSequence;
+  nextDisplayTime = QDateTime::currentDateTime().addMSecs(rotationMsec);
+  stalled = false;
+  Log("prefetch: took frame ", frame.imageDetails.filename, ", ", finished.size(), " ready, ", inFlight, " in flight");
+  return true;
+}
+
+bool ImagePrefetcher::isPending() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return inFlight > 0;
+}
+
+void ImagePrefetcher::invalidate()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  ++generation;
+  finished.clear();
+  Metrics::prefetchQueued.set(0);
+  nextDeliverSequence = nextSequence;
+  nextDisplayTime = QDateTime();
+  stalled = false;
+  failedInRow = 0;
+}
+
+void ImagePrefetcher::prepareFor(const QDateTime &displayTime)
+{
+  invalidate();
+  std::lock_guard<std::mutex> lock(mutex);
+  nextDisplayTime = displayTime;
+}
@@ -0,0 +1,78 @@
+#ifndef IMAGEPREFETCHER_H
+#define IMAGEPREFETCHER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QImage>
+#include <QThreadPool>
+#include <functional>
+#include <map>
+#include <mutex>
+#include "imagestructs.h"
+#include "imagerenderer.h"
+
+// an image that has been selected and fully composed, ready to go on screen
+struct PreparedFrame
+{
+    ImageDetails imageDetails;
+    QImage frame;
+    RenderSettings settings;
+    bool failed = false; // nothing could be composed, never handed out
+};
+
+// selects and composes the next few images on worker threads during the
+// rotation interval, so the timer tick only has to swap in a finished frame
+class ImagePrefetcher : public QObject
+{
+    Q_OBJECT
+public:
+    // displayTime is when the selected image is expected to go on screen
+    typedef std::function<ImageDetails(const ImageDisplayOptions &options, const QDateTime &displayTime)> SelectFunction;
+
+    ImagePrefetcher(SelectFunction selectImage, QObject *parent = nullptr);
+    ~ImagePrefetcher();
+    void setDepth(unsigned int depth);
+    void setMemoryBudget(unsigned int megabytes);
+    void setRotationTime(unsigned int msec);
+    bool isEnabled() const;
+    void setContext(const ImageDisplayOptions &options, const RenderSettings &settings);
+    void fill();
+    bool takeFrame(PreparedFrame &frame);
+    bool isPending() const;
+    void invalidate();
+    // drops what is queued and starts over with the image shown at displayTime
+    void prepareFor(const QDateTime &displayTime);
+
+signals:
+    void frameAvailable();
+
+private slots:
+    void jobFinished();
+
+private:
+    friend class PrefetchJob;
+    void runJob(quint64 jobGeneration, ImageDisplayOptions jobOptions, RenderSettings jobSettings);
+    unsigned int maxQueuedFrames() const;
+    QDateTime displayTimeOf(quint64 sequence) const;
+
+    SelectFunction selectImage;
+    QThreadPool pool;
+    mutable std::mutex mutex;
+    std::mutex selectMutex; // keeps selection order matching delivery order
+    unsigned int depth = 2;
+    size_t memoryBudget = 64 * 1024 * 1024;
+    qint64 rotationMsec = 0;
+    QDateTime nextDisplayTime; // when the next frame to deliver goes on screen, invalid for as soon as possible
+    ImageDisplayOptions options;
+    RenderSettings settings;
+    bool hasContext = false;
+    quint64 generation = 0;
+    quint64 nextSequence = 0;
+    quint64 nextDeliverSequence = 0;
+    unsigned int inFlight = 0;
+    bool stalled = false; // the last job found no image, wait for the next tick before trying again
+    unsigned int failedInRow = 0; // jobs in a row that couldn't compose any of their images
+    std::map<quint64, PreparedFrame> finished;
+};
+
+#endif // IMAGEPREFETCHER_H
@@ -0,0 +1,165 @@
+#include "imagerenderer.h"
+#include "logger.h"
+#include "framecache.h"
+#include "imagefilters.h"
+#include "metrics.h"
+#include <QPainter>
+#include <QImageReader>
+#include <QTransform>
+#include <QRect>
+#include <algorithm>
+#include <cmath>
+
+ImageRenderer::ImageRenderer(const RenderSettings &settingsIn):
+  settings(settingsIn)
+{
+}
+
+QImage ImageRenderer::render(const ImageDetails &imageDetails) const
+{
+    TraceSpan span("render");
+    FrameCache &frameCache = FrameCache::instance();
+    const QString cacheKey = frameCache.keyFor(imageDetails, settings);
+    QImage cached = frameCache.find(cacheKey);
+    if (!cached.isNull())
+    {
+      Metrics::frameCacheHits.add();
+      return cached;
+    }
+    Metrics::frameCacheMisses.add();
+
+    QImage p = loadImage(imageDetails);
+    Log("size:", p.width(), "x", p.height(), "(window:", width(), ",", height(), ")");
+    if (p.isNull() || width() <= 0 || height() <= 0)
+    {
+      return QImage();
+    }
+
+    QImage rotated = getRotatedImage(p, imageDetails);
+    QImage scaled = getScaledImage(rotated, imageDetails);
+    QImage background = getBlurredBackground(rotated, scaled, imageDetails);
+    drawForeground(background, scaled);
+    frameCache.insert(cacheKey, background);
+    return background;
+}
+
+QImage ImageRenderer::loadImage(const ImageDetails &imageDetails) const
+{
+    // already decoded while probing, don't do it twice unless the probe allowed more than we do
+    if (!imageDetails.image.isNull() && FitsDecodeLimits(imageDetails.image, settings.decodeLimits))
+    {
+      return imageDetails.image;
+    }
+
+    QImageReader reader( imageDetails.filename.c_str() );
+    reader.setAutoTransform(false); // we apply the exif rotation ourselves
+    const QSize sourceSize = reader.size();
+    const QSize decodeSize = sourceSize.isValid() ? getDecodeSize(sourceSize, imageDetails) : sourceSize;
+    return DecodeImage(reader, decodeSize, settings.decodeLimits);
+}
+
+QSize ImageRenderer::getDecodeSize(const QSize &sourceSize, const ImageDetails &imageDetails) const
+{
+    if (width() <= 0 || height() <= 0)
+    {
+      return sourceSize;
+    }
+
+    QSize displayedSize = sourceSize;
+    if (imageDetails.rotation == 90 || imageDetails.rotation == 270)
+    {
+      displayedSize.transpose();
+    }
+
+    // the background (and the image itself in stretch mode) is scaled to cover the
+    // screen, the fitted image never needs more than that, so decode at the cover scale
+    const double scale = std::max((double)width() / displayedSize.width(), (double)height() / displayedSize.height());
+    if (scale >= 1.0)
+    {
+      return sourceSize; // never upscale while decoding
+    }
+    return QSize(std::min(sourceSize.width(), (int)std::ceil(sourceSize.width() * scale)),
+                 std::min(sourceSize.height(), (int)std::ceil(sourceSize.height() * scale)));
+}
+
+void ImageRenderer::drawForeground(QImage& background, const QImage& foreground) const
+{
+    StageTimer timer(Metrics::composite);
+    QPainter pt(&background);
+    QBrush brush(QColor(0, 0, 0, 255-settings.backgroundOpacity));
+    pt.fillRect(0,0,background.width(), background.height(), brush);
+    pt.drawImage((background.width()-foreground.width())/2, (background.height()-foreground.height())/2, foreground);
+}
+
+QImage ImageRenderer::getBlurredBackground(const QImage& originalSize, const QImage& scaled, const ImageDetails &imageDetails) const
+{
+    if (imageDetails.options.fitAspectAxisToWindow) {
+      // our scaled version will just fill the whole screen, use it directly
+      QRect rect((scaled.width() - width())/2, 0, width(), height());
+      return scaled.copy(rect);
+    } else if (scaled.width() < width()) {
+      QImage background = blur(originalSize.scaledToWidth(width(), Qt::SmoothTransformation));
+      QRect rect(0, (background.height() - height())/2, width(), height());
+      return background.copy(rect);
+    } else {
+      // aspect 'p' or the image is not as wide as the screen
+      QImage background = blur(originalSize.scaledToHeight(height(), Qt::SmoothTransformation));
+      QRect rect((background.width() - width())/2, 0, width(), height());
+      return background.copy(rect);
+    }
+}
+
+QImage ImageRenderer::getRotatedImage(const QImage& p, const ImageDetails &imageDetails) const
+{
+    StageTimer timer(Metrics::rotate);
+    QTransform transform;
+    transform.rotate(imageDetails.rotation);
+    return p.transformed(transform);
+}
+
+QImage ImageRenderer::getScaledImage(const QImage& p, const ImageDetails &imageDetails) const
+{
+  StageTimer timer(Metrics::scale);
+  if (imageDetails.options.fitAspectAxisToWindow)
+  {
+    bool stretchWidth = imageDetails.aspect() == ImageAspect_Landscape;
+    bool stretchHeight = imageDetails.aspect() == ImageAspect_Portrait;
+    // check the stretched image will naturally fill the screen for its aspect ratio
+    if (stretchHeight && (width() > ((double)height()/p.height())*p.width()))
+    {
+      // stretched via height won't fill the width, so stretch the other way
+      stretchHeight = false;
+      stretchWidth = true;
+    }
+    else if (stretchWidth && (height() > ((double)width()/p.width())*p.height()))
+    {
+      // stretched via width won't fill the width, so stretch the other way
+      stretchWidth = false;
+      stretchHeight = true;
+    }
+
+    if (stretchHeight)
+    {
+      // potrait mode, make height of image fit screen and crop top/bottom
+      QImage pTemp = p.scaledToHeight(height(), Qt::SmoothTransformation);
+      return pTemp.copy(0,0,width(),height());
+    }
+    else if (stretchWidth)
+    {
+      // landscape mode, make width of image fit screen and crop top/bottom
+      QImage pTemp = p.scaledToWidth(width(), Qt::SmoothTransformation);
+      return pTemp.copy(0,0,width(),height());
+    }
+  }
+
+  // just scale the best we can for the given photo
+  return p.scaled(width(), height(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+QImage ImageRenderer::blur(const QImage& input) const
+{
+    StageTimer timer(Metrics::blur);
+    QImage res = input;
+    BlurImage(res, settings.blurRadius, settings.blurDownscale);
+    return res;
+}
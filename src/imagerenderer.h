@@ -0,0 +1,52 @@
+#ifndef IMAGERENDERER_H
+#define IMAGERENDERER_H
+
+#include <QImage>
+#include <QSize>
+#include "imagestructs.h"
+#include "imagedecoder.h"
+
+// settings that change how an image is composed into a screen sized frame
+struct RenderSettings
+{
+    QSize screenSize = {0,0};
+    unsigned int blurRadius = 20;
+    unsigned int backgroundOpacity = 150;
+    unsigned int blurDownscale = 4;
+    DecodeLimits decodeLimits;
+
+    bool operator==(const RenderSettings &b) const
+    {
+        return !operator!=(b);
+    }
+    bool operator!=(const RenderSettings &b) const
+    {
+        return screenSize != b.screenSize || blurRadius != b.blurRadius || backgroundOpacity != b.backgroundOpacity ||
+               blurDownscale != b.blurDownscale || decodeLimits != b.decodeLimits;
+    }
+};
+
+// composes the blurred background and scaled image into the final frame.
+// Only uses QImage so it is safe to run on a worker thread.
+class ImageRenderer
+{
+public:
+    ImageRenderer(const RenderSettings &settings);
+    QImage render(const ImageDetails &imageDetails) const;
+
+    QImage loadImage(const ImageDetails &imageDetails) const;
+    QSize getDecodeSize(const QSize &sourceSize, const ImageDetails &imageDetails) const;
+    QImage getRotatedImage(const QImage& p, const ImageDetails &imageDetails) const;
+    QImage getScaledImage(const QImage& p, const ImageDetails &imageDetails) const;
+    QImage getBlurredBackground(const QImage& originalSize, const QImage& scaled, const ImageDetails &imageDetails) const;
+    void drawForeground(QImage& background, const QImage& foreground) const;
+    QImage blur(const QImage& input) const;
+
+private:
+    int width() const { return settings.screenSize.width(); }
+    int height() const { return settings.screenSize.height(); }
+
+    RenderSettings settings;
+};
+
+#endif // IMAGERENDERER_H
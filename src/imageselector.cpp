@@ -2,16 +2,21 @@
 #include "pathtraverser.h"
 #include "mainwindow.h"
 #include "logger.h"
+#include "metadataindex.h"
+#include "imagedecoder.h"
+#include "metrics.h"
+#include "folderoptionscache.h"
 #include <QDirIterator>
 #include <QTimer>
 #include <QApplication>
 #include <QDir>
-#include <libexif/exif-data.h>
+#include <QImageReader>
 #include <iostream>
 #include <stdlib.h>     /* srand, rand */
 #include <time.h>       /* time */
 #include <algorithm>    // std::shuffle
 #include <random>       // std::default_random_engine
+#include <cctype>       // isdigit
 
 ImageSelector::ImageSelector(std::unique_ptr<PathTraverser>& pathTraverserIn):
   pathTraverser(std::move(pathTraverserIn))
@@ -22,51 +27,72 @@ ImageSelector::ImageSelector() {}
 
 ImageSelector::~ImageSelector(){}
 
-int ReadExifTag(ExifData* exifData, ExifTag tag, bool shortRead = false)
+void ImageSelector::setDisplayTime(const QTime &time)
 {
-  int value = -1;
-  ExifByteOrder byteOrder = exif_data_get_byte_order(exifData);
-  ExifEntry *exifEntry = exif_data_get_entry(exifData, tag);
+  displayTime = time;
+}
+
+qint64 ImageSelector::msecsToNextScheduleChange(const QTime &time) const
+{
+  Q_UNUSED(time);
+  return -1;
+}
+
+QTime ImageSelector::selectionTime() const
+{
+  return displayTime.isValid() ? displayTime : QTime::currentTime();
+}
 
-  if (exifEntry)
+bool ImageSelector::resolveOptions(const std::string&fileName, const ImageDisplayOptions &baseOptions, ImageDisplayOptions &options)
+{
+  // a folder's time windows only need its options, so check them before the image is probed
+  options = pathTraverser->UpdateOptionsForImage(fileName, baseOptions);
+  if (!imageInsideTimeWindow(options.timeWindows))
   {
-    if (shortRead)
-    {
-      return exif_get_short(exifEntry->data, byteOrder);
-    }
-    
-    return exif_get_long(exifEntry->data, byteOrder);
+    Metrics::imagesRejected.add();
+    return false;
   }
-  return value;
+  return true;
 }
 
-ImageDetails ImageSelector::populateImageDetails(const std::string&fileName, const ImageDisplayOptions &baseOptions)
+ImageDetails ImageSelector::populateImageDetails(const std::string&fileName, const ImageDisplayOptions &options)
 {
   ImageDetails imageDetails;
-  int orientation = -1;
-  int imageWidth = -1;
-  int imageHeight = -1;
-  ExifData *exifData = exif_data_new_from_file(fileName.c_str());
-  if (exifData)
+  MetadataIndex &metadataIndex = MetadataIndex::instance();
+  ImageMetadata metadata;
+  if (!metadataIndex.lookup(fileName, metadata))
   {
-    orientation = ReadExifTag(exifData, EXIF_TAG_ORIENTATION, true);
-
-    /*
-    // It looks like you can't trust Exif dimensions, so just forcefully load the file below
-    // try to get the image dimensions from exifData so we don't need to fully load the file
-    imageWidth = ReadExifTag(exifData, EXIF_TAG_IMAGE_WIDTH);
-    if ( imageWidth == -1)
-      imageWidth = ReadExifTag(exifData, EXIF_TAG_PIXEL_X_DIMENSION);
-
-    imageHeight = ReadExifTag(exifData, EXIF_TAG_RELATED_IMAGE_WIDTH); // means height, height is related to width
-    if ( imageHeight == -1)
-      imageHeight = ReadExifTag(exifData, EXIF_TAG_PIXEL_Y_DIMENSION);*/
-
-    exif_data_free(exifData);
+    Metrics::metadataIndexMisses.add();
+    const bool fileExists = ReadImageMetadata(fileName, metadata);
+
+    // Exif dimensions can't be trusted, but the container headers (JPEG SOF, PNG IHDR, TIFF IFD)
+    // can, and QImageReader only parses those to answer size()
+    QImageReader reader( fileName.c_str() );
+    reader.setAutoTransform(false);
+    QSize imageSize = reader.size();
+    if (!imageSize.isValid())
+    {
+      // the format can't tell us without decoding, so keep the decoded image for the renderer.
+      // It goes through the decoder's default caps like any other decode, the renderer checks
+      // it against its own
+      Log("no header size for ", fileName, ", decoding it");
+      imageDetails.image = DecodeImage(reader, QSize(), DecodeLimits());
+      imageSize = imageDetails.image.size();
+    }
+    metadata.width = imageSize.width();
+    metadata.height = imageSize.height();
+    if (fileExists && metadata.width > 0 && metadata.height > 0)
+    {
+      metadataIndex.store(fileName, metadata);
+    }
+  }
+  else
+  {
+    Metrics::metadataIndexHits.add();
   }
 
   int degrees = 0;
-  switch(orientation) {
+  switch(metadata.orientation) {
       case 8:
         degrees = 270;
         break;
@@ -79,14 +105,8 @@ ImageDetails ImageSelector::populateImageDetails(const std::string&fileName, con
       default:
         break;
   }
-
-  if (imageWidth <=0 || imageHeight <=0) 
-  {
-    // fallback to QPixmap to determine image size
-    QPixmap p( fileName.c_str() );
-    imageWidth = p.width();
-    imageHeight = p.height();
-  }
+  int imageWidth = metadata.width;
+  int imageHeight = metadata.height;
 
   // if the image is rotated then swap height/width here to show displayed sizes
   if( degrees == 90 || degrees == 270 )
@@ -100,9 +120,9 @@ ImageDetails ImageSelector::populateImageDetails(const std::string&fileName, con
   imageDetails.width = imageWidth;
   imageDetails.height = imageHeight;
   imageDetails.rotation = degrees;
+  imageDetails.metadata = metadata;
+  imageDetails.options = options;
 
-  imageDetails.options = pathTraverser->UpdateOptionsForImage(imageDetails.filename, baseOptions);
-  
   return imageDetails;
 }
 
@@ -112,7 +132,7 @@ bool ImageSelector::imageInsideTimeWindow(const QVector<DisplayTimeWindow> &time
   {
       return true; // no specified time windows means always display
   }
-  const QTime currentTime = QTime::currentTime();
+  const QTime currentTime = selectionTime();
   for(auto &window : timeWindows)
   {
     if(currentTime > window.startDisplay && currentTime < window.endDisplay)
@@ -131,22 +151,37 @@ bool ImageSelector::imageInsideTimeWindow(const QVector<DisplayTimeWindow> &time
   return false;
 }
 
+bool ImageSelector::imageKnownToMismatchAspect(const std::string&filename, const ImageAspectScreenFilter filter)
+{
+  if (filter == ImageAspectScreenFilter_Any)
+  {
+    return false;
+  }
+  ImageMetadata metadata;
+  if (!MetadataIndex::instance().peek(filename, metadata))
+  {
+    return false;
+  }
+  ImageDetails known;
+  const bool rotated = metadata.orientation == 6 || metadata.orientation == 8;
+  known.width = rotated ? metadata.height : metadata.width;
+  known.height = rotated ? metadata.width : metadata.height;
+  return !known.isValidForScreenAspect(filter);
+}
+
 bool ImageSelector::imageMatchesFilter(const ImageDetails& imageDetails)
 {
   if(!QFileInfo::exists(QString(imageDetails.filename.c_str())))
   {
     Log("file not found: ", imageDetails.filename);
+    Metrics::imagesRejected.add();
     return false;
   }
 
   if(!imageValidForAspect(imageDetails)) 
   {
     Log("image aspect ratio doesn't match filter '", imageDetails.options.onlyAspect, "' : ", imageDetails.filename);
-    return false;
-  }
-
-  if(!imageInsideTimeWindow(imageDetails.options.timeWindows))
-  {
+    Metrics::imagesRejected.add();
     return false;
   }
   return true;
@@ -175,154 +210,408 @@ const ImageDetails RandomImageSelector::getNextImage(const ImageDisplayOptions &
   ImageDetails imageDetails;
   try
   {
-    QStringList images = pathTraverser->getImages();
-    unsigned int selectedImage = selectRandom(images);
-    imageDetails = populateImageDetails(pathTraverser->getImagePath(images.at(selectedImage).toStdString()), baseOptions);
-    while(!imageMatchesFilter(imageDetails))
+    const int imageCount = pathTraverser->getImageCount();
+    Log("images: ", imageCount);
+    if (imageCount == 0)
+    {
+      throw std::string("No jpg images found in given folder");
+    }
+    updatePartitions(imageCount);
+
+    // every attempt either finds an image or classifies/rejects a candidate, so don't loop forever
+    const ImageAspectScreenFilter filter = baseOptions.onlyAspect;
+    const int maxAttempts = partitions.candidateCount(filter);
+    for (int attempt = 0; attempt < maxAttempts; ++attempt)
     {
-      unsigned int selectedImage = selectRandom(images);
-      imageDetails = populateImageDetails(pathTraverser->getImagePath(images.at(selectedImage).toStdString()), baseOptions);
+      const int candidates = partitions.candidateCount(filter);
+      if (candidates == 0)
+      {
+        break;
+      }
+      const int selectedImage = partitions.candidateAt(filter, rand() % candidates);
+      const std::string image = pathTraverser->getImageAt(selectedImage);
+      if (image.empty())
+      {
+        partitions.remove(selectedImage); // removed since it was partitioned
+        continue;
+      }
+      const std::string filename = pathTraverser->getImagePath(image);
+      ImageDisplayOptions options;
+      if (!resolveOptions(filename, baseOptions, options))
+      {
+        continue; // its folder isn't shown right now
+      }
+      imageDetails = populateImageDetails(filename, options);
+      partitions.classify(selectedImage, imageDetails.width, imageDetails.height, options.folderAspect);
+      if (imageMatchesFilter(imageDetails))
+      {
+        std::cout << "updating image: " << imageDetails.filename << std::endl;
+        return imageDetails;
+      }
     }
+    throw std::string("No images match the aspect filter");
   }
   catch(const std::string& err) 
   {
     std::cerr << "Error: " << err << std::endl;
   }
-  std::cout << "updating image: " << imageDetails.filename << std::endl;
-  return imageDetails;
+  return ImageDetails();
 }
 
-unsigned int RandomImageSelector::selectRandom(const QStringList& images) const
+void RandomImageSelector::updatePartitions(int imageCount)
 {
-  Log("images: ", images.size());
-  if (images.size() == 0)
+  const quint64 generation = pathTraverser->getGeneration();
+  const quint64 layout = pathTraverser->getIdLayout();
+  const quint64 optionsVersion = FolderOptionsCache::instance().getVersion();
+  if (generation == partitionsGeneration && layout == partitionsLayout && imageCount == partitions.size() &&
+      optionsVersion == partitionsOptionsVersion)
+  {
+    return;
+  }
+  // only a new layout renumbers what we have, anything else just adds indexes. A changed
+  // options.json can move images in or out of their folder's own aspect
+  if (layout != partitionsLayout || imageCount < partitions.size() || optionsVersion != partitionsOptionsVersion)
   {
-    throw std::string("No jpg images found in given folder");
+    partitions.clear();
   }
-  return rand() % images.size();
+  partitions.extend(*pathTraverser, imageCount);
+  partitionsGeneration = generation;
+  partitionsLayout = layout;
+  partitionsOptionsVersion = optionsVersion;
 }
 
-ShuffleImageSelector::ShuffleImageSelector(std::unique_ptr<PathTraverser>& pathTraverser):
-  ImageSelector(pathTraverser),
-  current_image_shuffle(-1),
-  images()
+AspectPartitions::Partition AspectPartitions::partitionFor(int width, int height)
 {
-  srand (time(NULL));
+  if (width <= 0 || height <= 0)
+    return Partition_Invalid;
+  if (width > height)
+    return Partition_Landscape;
+  if (height > width)
+    return Partition_Portrait;
+  return Partition_Square;
 }
 
-ShuffleImageSelector::~ShuffleImageSelector()
+void AspectPartitions::clear()
 {
+  for (auto &partition : partitions)
+  {
+    partition.clear();
+  }
+  partitionOf.clear();
+  positionInPartition.clear();
 }
 
-const ImageDetails ShuffleImageSelector::getNextImage(const ImageDisplayOptions &baseOptions)
+void AspectPartitions::extend(const PathTraverser &images, int imageCount)
 {
-  reloadImagesIfNoneLeft();
-  ImageDetails imageDetails;
-  if (images.size() == 0)
-  {
-    return imageDetails;
-  }
-  bool bReloadedImages = false;
-  imageDetails = populateImageDetails(pathTraverser->getImagePath(images.at(current_image_shuffle).toStdString()), baseOptions);
-  current_image_shuffle = current_image_shuffle + 1; // ignore and move to next image
-  while(!imageMatchesFilter(imageDetails)) {
-    if(current_image_shuffle >= images.size()) {
-      // don't keep looping
-      if(bReloadedImages == true)
-        return ImageDetails();
-      bReloadedImages = true;
+  const int first = partitionOf.size();
+  if (imageCount <= first)
+  {
+    return;
+  }
+  partitionOf.resize(imageCount);
+  positionInPartition.resize(imageCount);
+  MetadataIndex &metadataIndex = MetadataIndex::instance();
+  for (int i = first; i < imageCount; ++i)
+  {
+    Partition partition = Partition_Unknown;
+    ImageMetadata metadata;
+    const std::string image = images.getImageAt(i);
+    if (image.empty())
+    {
+      partition = Partition_Invalid; // removed, never a candidate
     }
-    reloadImagesIfNoneLeft();
-    imageDetails = populateImageDetails(pathTraverser->getImagePath(images.at(current_image_shuffle).toStdString()),baseOptions);
-    current_image_shuffle = current_image_shuffle + 1; // ignore and move to next image
+    else if (images.UpdateOptionsForImage(images.getImagePath(image), ImageDisplayOptions()).folderAspect)
+    {
+      partition = Partition_FolderAspect;
+    }
+    else if (metadataIndex.peek(image, metadata))
+    {
+      const bool rotated = metadata.orientation == 6 || metadata.orientation == 8;
+      partition = rotated ? partitionFor(metadata.height, metadata.width) : partitionFor(metadata.width, metadata.height);
+    }
+    partitionOf[i] = partition;
+    positionInPartition[i] = partitions[partition].size();
+    partitions[partition].append(i);
   }
-  std::cout << "updating image: " << imageDetails.filename << std::endl;
-  return imageDetails;
+  Log("aspect partitions: ", partitions[Partition_Landscape].size(), " landscape, ", partitions[Partition_Portrait].size(), " portrait, ",
+      partitions[Partition_Square].size(), " square, ", partitions[Partition_FolderAspect].size(), " with a folder aspect, ",
+      partitions[Partition_Unknown].size(), " unknown");
 }
 
-void ShuffleImageSelector::reloadImagesIfNoneLeft()
+bool AspectPartitions::partitionMatches(const Partition partition, const ImageAspectScreenFilter filter) const
 {
-  if (images.size() == 0 || current_image_shuffle >= images.size())
+  switch (partition)
   {
-    current_image_shuffle = 0;
-    images = pathTraverser->getImages();
-    std::cout << "Shuffling " << images.size() << " images." << std::endl;
-    std::random_device rd;
-    std::mt19937 randomizer(rd());
-    std::shuffle(images.begin(), images.end(), randomizer);
+    case Partition_Landscape:
+      return filter != ImageAspectScreenFilter_Portrait;
+    case Partition_Portrait:
+      return filter != ImageAspectScreenFilter_Landscape;
+    case Partition_Square:
+    case Partition_FolderAspect: // its options.json's filter is checked once it's drawn
+    case Partition_Unknown: // needs probing before we know
+      return true;
+    default:
+      return false;
   }
 }
 
-SortedImageSelector::SortedImageSelector(std::unique_ptr<PathTraverser>& pathTraverser):
+int AspectPartitions::candidateCount(const ImageAspectScreenFilter filter) const
+{
+  int count = 0;
+  for (int partition = 0; partition < Partition_Count; ++partition)
+  {
+    if (partitionMatches((Partition)partition, filter))
+      count += partitions[partition].size();
+  }
+  return count;
+}
+
+int AspectPartitions::candidateAt(const ImageAspectScreenFilter filter, int index) const
+{
+  for (int partition = 0; partition < Partition_Count; ++partition)
+  {
+    if (!partitionMatches((Partition)partition, filter))
+      continue;
+    if (index < partitions[partition].size())
+      return partitions[partition].at(index);
+    index -= partitions[partition].size();
+  }
+  return -1;
+}
+
+void AspectPartitions::classify(int image, int width, int height, bool folderAspect)
+{
+  move(image, folderAspect ? Partition_FolderAspect : partitionFor(width, height));
+}
+
+void AspectPartitions::remove(int image)
+{
+  move(image, Partition_Invalid);
+}
+
+void AspectPartitions::move(int image, Partition partition)
+{
+  const Partition current = (Partition)partitionOf[image];
+  if (current == partition)
+  {
+    return;
+  }
+  // swap remove from the old partition so moves stay O(1)
+  QVector<int> &from = partitions[current];
+  const int position = positionInPartition[image];
+  const int last = from.last();
+  from[position] = last;
+  positionInPartition[last] = position;
+  from.removeLast();
+
+  partitionOf[image] = partition;
+  positionInPartition[image] = partitions[partition].size();
+  partitions[partition].append(image);
+}
+
+ShuffleImageSelector::ShuffleImageSelector(std::unique_ptr<PathTraverser>& pathTraverser, const std::string &stateKey):
   ImageSelector(pathTraverser),
-  images()
+  order(stateKey.empty() ? this->pathTraverser->getPath() : stateKey)
 {
-  srand (time(NULL));
 }
 
-SortedImageSelector::~SortedImageSelector()
+ShuffleImageSelector::~ShuffleImageSelector()
 {
 }
 
-bool operator<(const QString& lhs, const QString& rhs) noexcept{
-  if (lhs.count(QLatin1Char('/')) < rhs.count(QLatin1Char('/'))) {
-    return true;
+const ImageDetails ShuffleImageSelector::getNextImage(const ImageDisplayOptions &baseOptions)
+{
+  const quint32 imageCount = pathTraverser->getImageCount();
+  if (imageCount == 0)
+  {
+    return ImageDetails();
   }
-  if (lhs.count(QLatin1Char('/')) > rhs.count(QLatin1Char('/'))) {
-    return false;
+  // the rest of this pass plus a whole new one without a match means nothing will match
+  const quint64 maxAttempts = (quint64)order.remaining() + imageCount;
+  for (quint64 attempt = 0; attempt < maxAttempts; ++attempt)
+  {
+    const std::string image = pathTraverser->getImageAt(order.next(imageCount));
+    if(image.empty())
+    {
+      continue; // removed since this pass started
+    }
+    const std::string filename = pathTraverser->getImagePath(image);
+    ImageDisplayOptions options;
+    if(!resolveOptions(filename, baseOptions, options))
+    {
+      continue; // its folder isn't shown right now
+    }
+    // against the folder's filter, its options.json may set a different aspect
+    if(imageKnownToMismatchAspect(filename, options.onlyAspect))
+    {
+      continue; // skip without touching the file
+    }
+    ImageDetails imageDetails = populateImageDetails(filename, options);
+    if(imageMatchesFilter(imageDetails))
+    {
+      order.save();
+      std::cout << "updating image: " << imageDetails.filename << std::endl;
+      return imageDetails;
+    }
   }
+  order.save();
+  return ImageDetails();
+}
 
-  return lhs.toStdString() < rhs.toStdString();
+SortedImageSelector::SortedImageSelector(std::unique_ptr<PathTraverser>& pathTraverser):
+  ImageSelector(pathTraverser)
+{
+}
 
+SortedImageSelector::~SortedImageSelector()
+{
 }
 
-const ImageDetails SortedImageSelector::getNextImage(const ImageDisplayOptions &baseOptions)
+// a key that sorts shallower paths first, so a folder's images come before its subfolders,
+// and numbers by value, so IMG_2 comes before IMG_10. Built once per image and compared
+// with memcmp instead of working it out on every comparison.
+static std::string sortKeyFor(const std::string& path)
 {
-  reloadImagesIfEmpty();
-  ImageDetails imageDetails;
-  if (images.size() == 0)
-  {
-    return imageDetails;
-  }
-  bool bReloadedImages = false;
-  imageDetails = populateImageDetails(pathTraverser->getImagePath(images.takeFirst().toStdString()), baseOptions);
-  while(!imageMatchesFilter(imageDetails)) {
-    if (images.size() == 0) {
-      // don't keep looping
-      if(bReloadedImages == true)
-        return ImageDetails();
-      bReloadedImages = true;
+  std::string key;
+  key.reserve(path.size() + 8);
+  const size_t depth = std::min<size_t>(std::count(path.begin(), path.end(), '/'), 0xffff);
+  key.push_back((char)(depth >> 8));
+  key.push_back((char)(depth & 0xff));
+  for (size_t i = 0; i < path.size();)
+  {
+    if (!isdigit((unsigned char)path[i]))
+    {
+      key.push_back(path[i++]);
+      continue;
+    }
+    size_t end = i;
+    while (end < path.size() && isdigit((unsigned char)path[end]))
+      ++end;
+    size_t start = i;
+    while (start + 1 < end && path[start] == '0')
+      ++start;
+    // a '0' keeps the number where its first digit would sort, then more digits means bigger
+    const size_t digits = std::min<size_t>(end - start, 0xff);
+    key.push_back('0');
+    key.push_back((char)digits);
+    key.append(path, start, digits);
+    i = end;
+  }
+  return key;
+}
+
+void SortedImageSelector::updateSortedImages()
+{
+  const quint64 generation = pathTraverser->getGeneration();
+  const quint64 layout = pathTraverser->getIdLayout();
+  if (sortedValid && generation == sortedGeneration && layout == sortedLayout)
+  {
+    return;
+  }
+  const int imageCount = pathTraverser->getImageCount();
+  // ids only ever get added unless the layout changes, so only the new ones need keys
+  const bool rebuild = !sortedValid || layout != sortedLayout || imageCount < sortedCount;
+  std::vector<SortEntry> added;
+  for (int image = rebuild ? 0 : sortedCount; image < imageCount; ++image)
+  {
+    const std::string path = pathTraverser->getImageAt(image);
+    if (!path.empty())
+    {
+      added.push_back({sortKeyFor(path), (quint32)image, false});
     }
+  }
+  std::sort(added.begin(), added.end());
 
-    reloadImagesIfEmpty();
-    imageDetails = populateImageDetails(pathTraverser->getImagePath(images.takeFirst().toStdString()), baseOptions);
+  if (rebuild)
+  {
+    sorted.swap(added);
+    position = 0;
+    removedEntries = 0;
+    Log( "read ", sorted.size(), " images.");
   }
+  else if (!added.empty())
+  {
+    // merge the new images in and carry on from the image that was up next
+    const bool atEnd = position >= sorted.size();
+    const SortEntry upNext = atEnd ? SortEntry() : sorted[position];
+    const size_t middle = sorted.size();
+    sorted.insert(sorted.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+    std::inplace_merge(sorted.begin(), sorted.begin() + middle, sorted.end());
+    position = atEnd ? sorted.size() : std::lower_bound(sorted.begin(), sorted.end(), upNext) - sorted.begin();
+    Log( "merged ", added.size(), " new images.");
+  }
+  sortedValid = true;
+  sortedGeneration = generation;
+  sortedLayout = layout;
+  sortedCount = imageCount;
+}
 
-  std::cout << "updating image: " << imageDetails.filename << std::endl;
-  imageDetails.options = pathTraverser->UpdateOptionsForImage(imageDetails.filename, imageDetails.options);
-  return imageDetails;
+void SortedImageSelector::startNextPass()
+{
+  position = 0;
+  if (removedEntries > 0)
+  {
+    sorted.erase(std::remove_if(sorted.begin(), sorted.end(), [](const SortEntry &entry) { return entry.removed; }), sorted.end());
+    removedEntries = 0;
+  }
 }
 
-void SortedImageSelector::reloadImagesIfEmpty()
+const std::string SortedImageSelector::takeNextImage()
 {
-  if (images.size() == 0)
+  if (position >= sorted.size())
   {
-    images = pathTraverser->getImages();
-    std::sort(images.begin(), images.end());
-    if(ShouldLog())
+    startNextPass();
+  }
+  if (sorted.empty())
+  {
+    return std::string();
+  }
+  SortEntry &entry = sorted[position++];
+  if (!entry.removed)
+  {
+    const std::string image = pathTraverser->getImageAt(entry.image);
+    if (!image.empty())
     {
-      Log( "read ", images.size(), " images.");
-      for (int i = 0;i <images.size();i++){
-          Log(images[i].toStdString());
-      }
+      return image;
+    }
+    // gone since it was sorted, drop it when the pass wraps
+    entry.removed = true;
+    ++removedEntries;
+  }
+  return std::string();
+}
+
+const ImageDetails SortedImageSelector::getNextImage(const ImageDisplayOptions &baseOptions)
+{
+  updateSortedImages();
+  // don't go round more than once looking for an image that matches
+  const size_t maxAttempts = sorted.size();
+  for (size_t attempt = 0; attempt < maxAttempts; ++attempt)
+  {
+    const std::string image = takeNextImage();
+    if (image.empty())
+    {
+      continue;
+    }
+    const std::string filename = pathTraverser->getImagePath(image);
+    ImageDisplayOptions options;
+    if (!resolveOptions(filename, baseOptions, options))
+    {
+      continue; // its folder isn't shown right now
+    }
+    ImageDetails imageDetails = populateImageDetails(filename, options);
+    if (imageMatchesFilter(imageDetails))
+    {
+      std::cout << "updating image: " << imageDetails.filename << std::endl;
+      return imageDetails;
     }
   }
+  return ImageDetails();
 }
 
 
 ListImageSelector::ListImageSelector()
 {
-  currentSelector = imageSelectors.begin();
 }
 
 ListImageSelector::~ListImageSelector() 
@@ -336,39 +625,65 @@ void ListImageSelector::AddImageSelector(std::unique_ptr<ImageSelector>& selecto
   entry.exclusive = exclusiveIn;
   entry.baseDisplayOptions = baseDisplayOptionsIn;
   imageSelectors.push_back(std::move(entry));
-  currentSelector = imageSelectors.begin();
+  currentSelector = -1;
+
+  QVector<QVector<DisplayTimeWindow>> windows;
+  QVector<bool> exclusive;
+  for (const auto &selectorEntry : imageSelectors)
+  {
+    windows.append(selectorEntry.baseDisplayOptions.timeWindows);
+    exclusive.append(selectorEntry.exclusive);
+  }
+  timeline.build(windows, exclusive);
+}
+
+std::unique_ptr<ImageSelector> ListImageSelector::takeImageSelector(size_t index)
+{
+  if (index >= imageSelectors.size())
+  {
+    return std::unique_ptr<ImageSelector>();
+  }
+  return std::move(imageSelectors[index].selector);
 }
 
+void ListImageSelector::setDisplayTime(const QTime &time)
+{
+  ImageSelector::setDisplayTime(time);
+  for (auto &selector : imageSelectors)
+  {
+    selector.selector->setDisplayTime(time);
+  }
+}
+
+qint64 ListImageSelector::msecsToNextScheduleChange(const QTime &time) const
+{
+  return timeline.msecsToNextChange(time);
+}
+
+const ImageDetails ListImageSelector::getNextImageFrom(int entry, const ImageDisplayOptions& baseOptions)
+{
+  ImageDisplayOptions options = baseOptions;
+  if (imageSelectors[entry].baseDisplayOptions.fitAspectAxisToWindow)
+    options.fitAspectAxisToWindow = true;
+  return imageSelectors[entry].selector->getNextImage(options);
+}
 
 const ImageDetails ListImageSelector::getNextImage(const ImageDisplayOptions& baseOptions)
 {
-  // check for exclusive time windows
-  for(auto& selector: imageSelectors)
+  const ScheduleTimeline::Segment &segment = timeline.segmentAt(selectionTime());
+  // an exclusive entry inside its time window is all that gets shown
+  if (segment.exclusive >= 0)
   {
-    if (imageInsideTimeWindow(selector.baseDisplayOptions.timeWindows) && selector.exclusive) 
-    {
-      ImageDisplayOptions options = baseOptions;
-      if (selector.baseDisplayOptions.fitAspectAxisToWindow)
-        options.fitAspectAxisToWindow = true;
-      return selector.selector->getNextImage(options);
-    }
+    return getNextImageFrom(segment.exclusive, baseOptions);
   }
-
-  // fall back to the next in the list
-  do
-  {  
-    ++currentSelector;
-    if(currentSelector == imageSelectors.end())
-    {
-      currentSelector = imageSelectors.begin();
-    }
-    if (imageInsideTimeWindow(currentSelector->baseDisplayOptions.timeWindows))
-    {
-      ImageDisplayOptions options = baseOptions;
-      if (currentSelector->baseDisplayOptions.fitAspectAxisToWindow)
-        options.fitAspectAxisToWindow = true;
-      return currentSelector->selector->getNextImage(options);
-    }
+  if (segment.active.isEmpty())
+  {
+    Log("no scheduler entry is active at ", selectionTime().toString().toStdString());
+    return ImageDetails();
   }
-  while(true);
-}
\ No newline at end of file
+
+  // otherwise take turns between the active entries
+  auto next = std::upper_bound(segment.active.begin(), segment.active.end(), currentSelector);
+  currentSelector = next == segment.active.end() ? segment.active.first() : *next;
+  return getNextImageFrom(currentSelector, baseOptions);
+}
@@ -6,10 +6,39 @@
 #include <QStringList>
 #include <QVector>
 #include "imagestructs.h"
+#include "shuffleorder.h"
+#include "scheduletimeline.h"
 
 class MainWindow;
 class PathTraverser;
 
+// the images of a list grouped by their known aspect ratio, so an aspect filtered
+// selection can draw straight from the matching images instead of probing rejects.
+// Indexes only ever get added while the list's id layout stays the same, so only new ones
+// are looked at; removed images are dropped when they come up. Images whose options.json
+// sets its own aspect are kept apart and always drawn, their folder's filter decides.
+class AspectPartitions
+{
+public:
+    void clear();
+    void extend(const PathTraverser &images, int imageCount);
+    int size() const { return partitionOf.size(); }
+    int candidateCount(const ImageAspectScreenFilter filter) const;
+    int candidateAt(const ImageAspectScreenFilter filter, int index) const;
+    void classify(int image, int width, int height, bool folderAspect);
+    void remove(int image);
+
+private:
+    enum Partition { Partition_Landscape = 0, Partition_Portrait, Partition_Square, Partition_FolderAspect, Partition_Unknown, Partition_Invalid, Partition_Count };
+    static Partition partitionFor(int width, int height);
+    bool partitionMatches(const Partition partition, const ImageAspectScreenFilter filter) const;
+    void move(int image, Partition partition);
+
+    QVector<int> partitions[Partition_Count]; // indexes into the image list
+    QVector<int> partitionOf;
+    QVector<int> positionInPartition;
+};
+
 class ImageSelector
 {
 public:
@@ -17,13 +46,22 @@ public:
     ImageSelector(); // use case for when you don't own your own traverser
     virtual ~ImageSelector();
     virtual const ImageDetails getNextImage(const ImageDisplayOptions &baseOptions) = 0;
+    // when the next image will be on screen, prefetching picks images ahead of time. An invalid
+    // time means now
+    virtual void setDisplayTime(const QTime &time);
+    // how long until the schedule shows images from something else, -1 if it never does
+    virtual qint64 msecsToNextScheduleChange(const QTime &time) const;
  
 protected:
-    ImageDetails populateImageDetails(const std::string&filename, const ImageDisplayOptions &baseOptions);
+    ImageDetails populateImageDetails(const std::string&filename, const ImageDisplayOptions &options);
+    bool resolveOptions(const std::string&filename, const ImageDisplayOptions &baseOptions, ImageDisplayOptions &options);
+    bool imageKnownToMismatchAspect(const std::string&filename, const ImageAspectScreenFilter filter);
     bool imageValidForAspect(const ImageDetails& imageDetails);
     bool imageMatchesFilter(const ImageDetails& imageDetails);
     bool imageInsideTimeWindow(const QVector<DisplayTimeWindow> &timeWindows);
+    QTime selectionTime() const;
     std::unique_ptr<PathTraverser> pathTraverser;
+    QTime displayTime;
 };
 
 class RandomImageSelector : public ImageSelector
@@ -34,20 +72,23 @@ public:
     virtual const ImageDetails getNextImage(const ImageDisplayOptions &baseOptions);
 
 private:
-    unsigned int selectRandom(const QStringList& images) const;
+    void updatePartitions(int imageCount);
+    AspectPartitions partitions;
+    quint64 partitionsGeneration = 0;
+    quint64 partitionsLayout = ~0ULL;
+    quint64 partitionsOptionsVersion = 0;
 };
 
 class ShuffleImageSelector : public ImageSelector
 {
 public:
-    ShuffleImageSelector(std::unique_ptr<PathTraverser>& pathTraverser);
+    // stateKey names the saved position, the traverser's path when empty
+    ShuffleImageSelector(std::unique_ptr<PathTraverser>& pathTraverser, const std::string &stateKey = std::string());
     virtual ~ShuffleImageSelector();
     virtual const ImageDetails getNextImage(const ImageDisplayOptions &baseOptions);
 
 private:
-    void reloadImagesIfNoneLeft();
-    int current_image_shuffle;
-    QStringList images;
+    ShuffleOrder order;
 };
 
 class SortedImageSelector : public ImageSelector
@@ -58,8 +99,27 @@ public:
     virtual const ImageDetails getNextImage(const ImageDisplayOptions &baseOptions);
 
 private:
-    void reloadImagesIfEmpty();
-    QStringList images;
+    struct SortEntry
+    {
+        std::string key; // compared bytewise, see sortKeyFor()
+        quint32 image;
+        bool removed;
+        bool operator<(const SortEntry &b) const
+        {
+            const int order = key.compare(b.key);
+            return order != 0 ? order < 0 : image < b.image;
+        }
+    };
+    void updateSortedImages();
+    void startNextPass();
+    const std::string takeNextImage();
+    std::vector<SortEntry> sorted; // display order
+    size_t position = 0;
+    size_t removedEntries = 0;
+    bool sortedValid = false;
+    quint64 sortedGeneration = 0;
+    quint64 sortedLayout = 0;
+    int sortedCount = 0; // indexes below this have a key
 };
 
 class ListImageSelector : public ImageSelector
@@ -68,7 +128,10 @@ public:
     ListImageSelector();
     virtual ~ListImageSelector();
     virtual const ImageDetails getNextImage(const ImageDisplayOptions &baseOptions);
+    virtual void setDisplayTime(const QTime &time);
+    virtual qint64 msecsToNextScheduleChange(const QTime &time) const;
     void AddImageSelector(std::unique_ptr<ImageSelector>& selector, const bool exclusiveIn, const ImageDisplayOptions& baseDisplayOptionsIn);
+    std::unique_ptr<ImageSelector> takeImageSelector(size_t index); // leaves that entry empty, for handing it to a new list
 
 private:
     struct SelectoryEntry {
@@ -76,7 +139,9 @@ private:
         ImageDisplayOptions baseDisplayOptions;
         bool exclusive = false;
     };
+    const ImageDetails getNextImageFrom(int entry, const ImageDisplayOptions& baseOptions);
     std::vector<SelectoryEntry> imageSelectors;
-    std::vector<SelectoryEntry>::iterator currentSelector;
+    ScheduleTimeline timeline;
+    int currentSelector = -1;
 };
 #endif // IMAGESELECTOR_H
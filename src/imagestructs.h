@@ -2,8 +2,10 @@
 #define IMAGESTRUCTS_H
 
 #include <QTime>
+#include <QImage>
 #include <QVector>
 #include <string>
+#include "imagemetadata.h"
 
 // possible aspect ratios of an image
 enum ImageAspect { ImageAspect_Landscape = 0, ImageAspect_Portrait};
@@ -24,6 +26,7 @@ struct DisplayTimeWindow
 struct ImageDisplayOptions
 {
     ImageAspectScreenFilter onlyAspect = ImageAspectScreenFilter_Any;
+    bool folderAspect = false; // onlyAspect came from an options.json rather than the config
     bool fitAspectAxisToWindow = false;
     QVector<DisplayTimeWindow> timeWindows;
 };
@@ -43,6 +46,8 @@ public:
     int rotation = 0;
     std::string filename;
     ImageDisplayOptions options;
+    ImageMetadata metadata; // exif and file details, parsed once and shared by everything showing the image
+    QImage image; // only set if the image had to be fully decoded while probing it
 };
 
 
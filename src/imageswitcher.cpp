@@ -1,11 +1,14 @@
 #include "imageswitcher.h"
 #include "imageselector.h"
 #include "mainwindow.h"
+#include "logger.h"
+#include "metrics.h"
 #include <QDirIterator>
 #include <QTimer>
 #include <QApplication>
 #include <iostream>
 #include <memory>
+#include <algorithm>
 #include <stdlib.h>     /* srand, rand */
 #include <time.h>       /* time */
 
@@ -15,25 +18,83 @@ ImageSwitcher::ImageSwitcher(MainWindow& w, unsigned int timeoutMsec, std::uniqu
     timeout(timeoutMsec),
     selector(std::move(selector)),
     timer(this),
-    timerNoContent(this)
+    timerNoContent(this),
+    scheduleTimer(this),
+    schedulePrefetchTimer(this),
+    prefetcher([this](const ImageDisplayOptions &options, const QDateTime &displayTime) { return selectNextImage(options, displayTime); })
 {
+    connect(&prefetcher, SIGNAL(frameAvailable()), this, SLOT(prefetchedFrameAvailable()));
+    prefetcher.setRotationTime(timeout);
+    // windows can be hours away, coarse timers would be minutes late
+    scheduleTimer.setSingleShot(true);
+    scheduleTimer.setTimerType(Qt::PreciseTimer);
+    schedulePrefetchTimer.setSingleShot(true);
+    schedulePrefetchTimer.setTimerType(Qt::PreciseTimer);
+    connect(&scheduleTimer, SIGNAL(timeout()), this, SLOT(scheduleChangeReached()));
+    connect(&schedulePrefetchTimer, SIGNAL(timeout()), this, SLOT(scheduleChangeApproaching()));
+}
+
+ImageDetails ImageSwitcher::selectNextImage(const ImageDisplayOptions &options, const QDateTime &displayTime)
+{
+    std::lock_guard<std::mutex> lock(selectorMutex);
+    StageTimer timer(Metrics::select);
+    selector->setDisplayTime(displayTime.time());
+    const ImageDetails imageDetails = selector->getNextImage(options);
+    if (!imageDetails.filename.empty())
+    {
+      Metrics::imagesSelected.add();
+    }
+    return imageDetails;
 }
 
 void ImageSwitcher::updateImage()
 {
-    if(reloadConfigIfNeeded)
+    Trace::instance().switchStarting();
+    TraceSpan span("updateImage");
+    if (prefetcher.isEnabled())
+    {
+      prefetcher.setContext(window.getBaseOptions(), window.getRenderSettings());
+      PreparedFrame frame;
+      waitingForFrame = !prefetcher.takeFrame(frame);
+      if (!waitingForFrame)
+      {
+        showFrame(frame);
+      }
+      // otherwise nothing is composed yet, it gets swapped in as soon as a worker finishes
+      prefetcher.fill();
+      return;
+    }
+
+    PreparedFrame frame;
+    frame.imageDetails = selectNextImage(window.getBaseOptions(), QDateTime());
+    showFrame(frame);
+}
+
+void ImageSwitcher::prefetchedFrameAvailable()
+{
+    if (!waitingForFrame)
     {
-      reloadConfigIfNeeded(window, this);
+      return;
     }
-    ImageDetails imageDetails = selector->getNextImage(window.getBaseOptions());
-    if (imageDetails.filename == "")
+    PreparedFrame frame;
+    if (prefetcher.takeFrame(frame))
+    {
+      waitingForFrame = false;
+      showFrame(frame);
+      prefetcher.fill();
+    }
+}
+
+void ImageSwitcher::showFrame(const PreparedFrame &frame)
+{
+    if (frame.imageDetails.filename == "")
     {
       window.warn("No image found.");
       timerNoContent.start(timeoutNoContent);
     }
     else
     {
-      window.setImage(imageDetails);
+      window.setFrame(frame);
       timerNoContent.stop(); // we have loaded content so stop the fast polling
     }
 }
@@ -44,26 +105,84 @@ void ImageSwitcher::start()
     connect(&timer, SIGNAL(timeout()), this, SLOT(updateImage()));
     connect(&timerNoContent, SIGNAL(timeout()), this, SLOT(updateImage()));
     timer.start(timeout);
+    armScheduleTimers();
 }
 
-void ImageSwitcher::scheduleImageUpdate()
+void ImageSwitcher::armScheduleTimers()
 {
-  // update our image in 100msec, to let the system settle
-  QTimer::singleShot(100, this, SLOT(updateImage())); 
+    qint64 msecs = -1;
+    {
+      std::lock_guard<std::mutex> lock(selectorMutex);
+      msecs = selector->msecsToNextScheduleChange(QTime::currentTime());
+    }
+    scheduleTimer.stop();
+    schedulePrefetchTimer.stop();
+    if (msecs < 0)
+    {
+      return;
+    }
+    scheduleChange = QDateTime::currentDateTime().addMSecs(msecs);
+    scheduleTimer.start((int)msecs);
+    if (prefetcher.isEnabled())
+    {
+      schedulePrefetchTimer.start((int)std::max((qint64)0, msecs - schedulePrefetchLead));
+    }
 }
 
-void ImageSwitcher::setConfigFileReloader(std::function<void(MainWindow &w, ImageSwitcher *switcher)> reloadConfigIfNeededIn)
+void ImageSwitcher::scheduleChangeApproaching()
 {
-  reloadConfigIfNeeded = reloadConfigIfNeededIn;
+    // hold the current image until the change, and have the first image of the new
+    // window ready by then instead of whatever was prefetched for the old one
+    timer.stop();
+    prefetcher.prepareFor(scheduleChange);
+    prefetcher.fill();
+}
+
+void ImageSwitcher::scheduleChangeReached()
+{
+    Log("schedule changed at ", scheduleChange.time().toString().toStdString());
+    timer.start(timeout);
+    updateImage();
+    armScheduleTimers();
+}
+
+void ImageSwitcher::scheduleImageUpdate()
+{
+  // anything already prefetched was picked for the old settings
+  prefetcher.invalidate();
+  // update our image in 100msec, to let the system settle
+  QTimer::singleShot(100, this, SLOT(updateImage())); 
 }
 
 void ImageSwitcher::setRotationTime(unsigned int timeoutMsecIn)
 {
   timeout = timeoutMsecIn;
+  prefetcher.setRotationTime(timeout);
   timer.start(timeout);
 }
 
 void ImageSwitcher::setImageSelector(std::unique_ptr<ImageSelector>& selectorIn)
 {
-  selector = std::move(selectorIn);
+  {
+    std::lock_guard<std::mutex> lock(selectorMutex);
+    selector = std::move(selectorIn);
+  }
+  prefetcher.invalidate();
+  armScheduleTimers();
+}
+
+void ImageSwitcher::updateImageSelector(const std::function<void(std::unique_ptr<ImageSelector>& selector)> &update)
+{
+  {
+    std::lock_guard<std::mutex> lock(selectorMutex);
+    update(selector);
+  }
+  prefetcher.invalidate();
+  armScheduleTimers();
+}
+
+void ImageSwitcher::setPrefetch(unsigned int depth, unsigned int memoryBudgetMB)
+{
+  prefetcher.setDepth(depth);
+  prefetcher.setMemoryBudget(memoryBudgetMB);
 }
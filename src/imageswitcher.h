@@ -2,11 +2,14 @@
 #define IMAGESWITCHER_H
 
 #include <QObject>
+#include <QDateTime>
 #include <QTimer>
 #include <iostream>
 #include <memory>
 #include <functional>
+#include <mutex>
 #include "imageselector.h"
+#include "imageprefetcher.h"
 
 class MainWindow;
 class ImageSwitcher : public QObject
@@ -16,20 +19,36 @@ public:
     ImageSwitcher(MainWindow& w, unsigned int timeoutMsec, std::unique_ptr<ImageSelector>& selector);
     void start();
     void scheduleImageUpdate();
-    void setConfigFileReloader(std::function<void(MainWindow &w, ImageSwitcher *switcher)> reloadConfigIfNeededIn);
     void setRotationTime(unsigned int timeoutMsec);
     void setImageSelector(std::unique_ptr<ImageSelector>& selector);
+    // lets update rework the selector in place, with no image being selected meanwhile
+    void updateImageSelector(const std::function<void(std::unique_ptr<ImageSelector>& selector)> &update);
+    void setPrefetch(unsigned int depth, unsigned int memoryBudgetMB);
 
 public slots:
     void updateImage();
+private slots:
+    void prefetchedFrameAvailable();
+    void scheduleChangeApproaching();
+    void scheduleChangeReached();
 private:
+    ImageDetails selectNextImage(const ImageDisplayOptions &options, const QDateTime &displayTime);
+    void showFrame(const PreparedFrame &frame);
+    void armScheduleTimers();
+
     MainWindow& window;
     unsigned int timeout;
+    std::mutex selectorMutex;
     std::unique_ptr<ImageSelector> selector;
     QTimer timer;
     const unsigned int timeoutNoContent = 5 * 1000; // 5 sec
     QTimer timerNoContent;
-    std::function<void(MainWindow &w, ImageSwitcher *switcher)> reloadConfigIfNeeded;
+    const unsigned int schedulePrefetchLead = 10 * 1000; // start preparing the next window's first image this early
+    QTimer scheduleTimer; // fires when a scheduler time window opens or closes
+    QTimer schedulePrefetchTimer;
+    QDateTime scheduleChange;
+    bool waitingForFrame = false;
+    ImagePrefetcher prefetcher; // keep last, its workers use the selector above
 };
 
 #endif // IMAGESWITCHER_H
@@ -0,0 +1,49 @@
+#include "libraryregistry.h"
+#include "imagelibrary.h"
+#include "imagelistfile.h"
+#include "logger.h"
+#include <QDir>
+#include <QFileInfo>
+
+LibraryRegistry &LibraryRegistry::instance()
+{
+  static LibraryRegistry registry;
+  return registry;
+}
+
+std::shared_ptr<ImageLibrary> LibraryRegistry::library(const std::string &path, bool recursive)
+{
+  const QString absolutePath = QDir(QString::fromStdString(path)).absolutePath();
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = libraries.begin(); it != libraries.end();)
+  {
+    std::shared_ptr<ImageLibrary> library = it->lock();
+    if (!library)
+    {
+      it = libraries.erase(it);
+      continue;
+    }
+    if (library->covers(absolutePath, recursive))
+    {
+      Log("Sharing library for ", absolutePath.toStdString());
+      return library;
+    }
+    ++it;
+  }
+  std::shared_ptr<ImageLibrary> library(new ImageLibrary(path, recursive));
+  libraries.push_back(library);
+  return library;
+}
+
+std::shared_ptr<ImageListFile> LibraryRegistry::listFile(const std::string &path)
+{
+  const QString absolutePath = QFileInfo(QString::fromStdString(path)).absoluteFilePath();
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<ImageListFile> list = listFiles[absolutePath].lock();
+  if (!list)
+  {
+    list.reset(new ImageListFile(path));
+    listFiles[absolutePath] = list;
+  }
+  return list;
+}
@@ -0,0 +1,34 @@
+#ifndef LIBRARYREGISTRY_H
+#define LIBRARYREGISTRY_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <QString>
+
+class ImageLibrary;
+class ImageListFile;
+
+// hands out the libraries and list files behind the traversers, so entries that point
+// at the same tree (or a folder inside one already scanned recursively) share a single
+// scan, watcher and store. Only weak references are kept, a library goes away with the
+// last traverser using it.
+class LibraryRegistry
+{
+public:
+    static LibraryRegistry &instance();
+
+    std::shared_ptr<ImageLibrary> library(const std::string &path, bool recursive);
+    std::shared_ptr<ImageListFile> listFile(const std::string &path);
+
+private:
+    LibraryRegistry() {}
+
+    std::mutex mutex;
+    std::vector<std::weak_ptr<ImageLibrary>> libraries;
+    std::map<QString, std::weak_ptr<ImageListFile>> listFiles;
+};
+
+#endif // LIBRARYREGISTRY_H
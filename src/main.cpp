@@ -5,6 +5,13 @@
 #include "overlay.h"
 #include "appconfig.h"
 #include "logger.h"
+#include "framecache.h"
+#include "imagelibrary.h"
+#include "libraryregistry.h"
+#include "configwatcher.h"
+#include "headlessrunner.h"
+#include "metricswriter.h"
+#include "trace.h"
 
 #include <QApplication>
 #include <QRegularExpression>
@@ -16,24 +23,36 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <memory>
+#include <algorithm>
 
 void usage(std::string programName) {
-    std::cerr << "Usage: " << programName << " [-t rotation_seconds] [-T transition_seconds] [-h/--overlay-color #rrggbb] [-a aspect('l','p','a', 'm')] [-o background_opacity(0..255)] [-b blur_radius] -p image_folder [-r] [-s] [-S] [-v] [--verbose] [--stretch] [-c config_file_path]" << std::endl;
+    std::cerr << "Usage: " << programName << " [-t rotation_seconds] [-T transition_seconds] [-h/--overlay-color #rrggbb] [-a aspect('l','p','a', 'm')] [-o background_opacity(0..255)] [-b blur_radius] -p image_folder|-i imageFile,...|-l list_file [-r] [-s] [-S] [-v] [--verbose] [--stretch] [-c config_file_path] [--headless WxH [--frames count] [--interval msec] [--frame-dir folder] [--frame-cache]] [--metrics-file path] [--trace path [--trace-switches count]]" << std::endl;
 }
 
 bool parseCommandLine(AppConfig &appConfig, int argc, char *argv[]) {
   int opt;
   int debugInt = 0;
   int stretchInt = 0;
+  int frameCacheInt = 0;
   static struct option long_options[] =
   {
     {"verbose",       no_argument,       &debugInt,   1},
     {"stretch",       no_argument,       &stretchInt, 1},
     {"overlay-color", required_argument, 0,           'h'},
+    {"headless",      required_argument, 0,           'H'},
+    {"frames",        required_argument, 0,           'F'},
+    {"interval",      required_argument, 0,           'I'},
+    {"frame-dir",     required_argument, 0,           'D'},
+    {"frame-cache",   no_argument,       &frameCacheInt, 1},
+    {"metrics-file",  required_argument, 0,           'M'},
+    {"trace",         required_argument, 0,           'R'},
+    {"trace-switches",required_argument, 0,           'W'},
+    {0,               0,                 0,           0},
   };
   int option_index = 0;
-  while ((opt = getopt_long(argc, argv, "b:p:t:T:o:O:a:i:c:h:rsSv", long_options, &option_index)) != -1) {
+  while ((opt = getopt_long(argc, argv, "b:p:t:T:o:O:a:i:l:c:h:rsSv", long_options, &option_index)) != -1) {
     switch (opt) {
       case 0:
           /* If this option set a flag, do nothing else now. */
@@ -99,9 +118,43 @@ bool parseCommandLine(AppConfig &appConfig, int argc, char *argv[]) {
           appConfig.paths.append(PathEntry());
         appConfig.paths[0].imageList = optarg;
         break;
+      case 'l':
+        if(appConfig.paths.count() == 0)
+          appConfig.paths.append(PathEntry());
+        appConfig.paths[0].imageListFile = optarg;
+        break;
       case 'c':
         appConfig.configPath = optarg;
         break;
+      case 'H':
+      {
+        QStringList size = QString(optarg).split('x');
+        if (size.count() != 2 || size[0].toInt() <= 0 || size[1].toInt() <= 0)
+        {
+          std::cout << "Error: headless size expected as WxH, e.g. 1920x1080" << std::endl;
+          return false;
+        }
+        appConfig.headlessSize = QSize(size[0].toInt(), size[1].toInt());
+        break;
+      }
+      case 'F':
+        appConfig.headlessFrames = atoi(optarg);
+        break;
+      case 'I':
+        appConfig.headlessIntervalMsec = atoi(optarg);
+        break;
+      case 'D':
+        appConfig.headlessFrameDirectory = optarg;
+        break;
+      case 'M':
+        appConfig.metricsFile = optarg;
+        break;
+      case 'R':
+        appConfig.traceFile = optarg;
+        break;
+      case 'W':
+        appConfig.traceSwitches = atoi(optarg);
+        break;
       default: /* '?' */
         return false;
     }
@@ -115,6 +168,10 @@ bool parseCommandLine(AppConfig &appConfig, int argc, char *argv[]) {
   {
     appConfig.baseDisplayOptions.fitAspectAxisToWindow = true;
   }
+  if(frameCacheInt==1)
+  {
+    appConfig.headlessFrameCache = true;
+  }
 
   return true;
 }
@@ -125,6 +182,8 @@ void ConfigureWindowFromSettings(MainWindow &w, const AppConfig &appConfig)
   {
     w.setBlurRadius(appConfig.blurRadius);
   }
+  w.setBlurDownscale(appConfig.blurDownscale);
+  w.setDecodeLimits(appConfig.decodeMaxMB, appConfig.decodeMaxMegapixels);
 
   if (appConfig.backgroundOpacity>= 0)
   {
@@ -132,6 +191,8 @@ void ConfigureWindowFromSettings(MainWindow &w, const AppConfig &appConfig)
   }
 
   w.setTransitionTime(appConfig.transitionTime);
+  w.setTransitionFps(appConfig.transitionFps);
+  FrameCache::instance().setLimits(appConfig.frameCacheMB, appConfig.frameCacheMemoryMB);
 
   if (!appConfig.overlayHexRGB.isEmpty())
   {
@@ -157,7 +218,11 @@ void ConfigureWindowFromSettings(MainWindow &w, const AppConfig &appConfig)
 std::unique_ptr<ImageSelector> GetSelectorForConfig(const PathEntry& path)
 {
   std::unique_ptr<PathTraverser> pathTraverser;
-  if (!path.imageList.empty())
+  if (!path.imageListFile.empty())
+  {
+    pathTraverser = std::unique_ptr<PathTraverser>(new ImageListFilePathTraverser(path.imageListFile));
+  }
+  else if (!path.imageList.empty())
   {
     pathTraverser = std::unique_ptr<PathTraverser>(new ImageListPathTraverser(path.imageList));
   }
@@ -177,7 +242,7 @@ std::unique_ptr<ImageSelector> GetSelectorForConfig(const PathEntry& path)
   }
   else if (path.shuffle)
   {
-    selector = std::unique_ptr<ImageSelector>(new ShuffleImageSelector(pathTraverser));
+    selector = std::unique_ptr<ImageSelector>(new ShuffleImageSelector(pathTraverser, path.stateKey()));
   }
   else
   {
@@ -187,58 +252,176 @@ std::unique_ptr<ImageSelector> GetSelectorForConfig(const PathEntry& path)
   return selector;
 }
 
-std::unique_ptr<ImageSelector> GetSelectorForApp(const AppConfig& appConfig)
+// scan the widest recursive folders first, so entries inside them become views of the same library
+std::vector<std::shared_ptr<ImageLibrary>> PrepareLibraries(const AppConfig& appConfig)
+{
+  std::vector<std::shared_ptr<ImageLibrary>> libraries;
+  QVector<PathEntry> widestFirst = appConfig.paths;
+  std::stable_sort(widestFirst.begin(), widestFirst.end(), [](const PathEntry &a, const PathEntry &b) {
+    if (a.recursive != b.recursive)
+      return a.recursive;
+    return a.path.size() < b.path.size();
+  });
+  for(const auto &path : widestFirst)
+  {
+    if (path.imageList.empty() && path.imageListFile.empty() && !path.path.empty())
+      libraries.push_back(LibraryRegistry::instance().library(path.path, path.recursive));
+  }
+  return libraries;
+}
+
+// one selector per path entry, scheduled by a list when there is more than one
+std::unique_ptr<ImageSelector> AssembleSelector(const AppConfig& appConfig, std::vector<std::unique_ptr<ImageSelector>> &selectors)
 {
   if(appConfig.paths.count()==1)
   {
-    return GetSelectorForConfig(appConfig.paths[0]);
+    return std::move(selectors[0]);
   }
-  else
+  std::unique_ptr<ListImageSelector> listSelector(new ListImageSelector());
+  for(int i = 0; i < appConfig.paths.count(); ++i)
   {
-    std::unique_ptr<ListImageSelector> listSelector(new ListImageSelector());
-    for(const auto &path : appConfig.paths)
-    {
-      auto selector = GetSelectorForConfig(path);
-      listSelector->AddImageSelector(selector, path.exclusive, path.baseDisplayOptions);
-    }
-    // new things
-    return listSelector;
+    listSelector->AddImageSelector(selectors[i], appConfig.paths[i].exclusive, appConfig.paths[i].baseDisplayOptions);
   }
+  return listSelector;
 }
 
-
-void ReloadConfigIfNeeded(AppConfig &appConfig, MainWindow &w, ImageSwitcher *switcher)
-{  
-  if(appConfig.configPath.empty())
+std::unique_ptr<ImageSelector> GetSelectorForApp(const AppConfig& appConfig)
+{
+  std::vector<std::shared_ptr<ImageLibrary>> libraries;
+  if(appConfig.paths.count() > 1)
   {
-    return;
+    libraries = PrepareLibraries(appConfig);
   }
-  
-  QString jsonFile = getAppConfigFilePath(appConfig.configPath);
-  QDir directory;
-  if(!directory.exists(jsonFile))
+  std::vector<std::unique_ptr<ImageSelector>> selectors;
+  for(const auto &path : appConfig.paths)
   {
-    return;
+    selectors.push_back(GetSelectorForConfig(path));
+  }
+  return AssembleSelector(appConfig, selectors);
+}
+
+// swaps in the selector for a new config, handing the selectors of entries that still show the
+// same images over to it, so their scanned images and shuffle or sort positions carry on
+void UpdateSelectorForApp(const AppConfig &oldConfig, const AppConfig &newConfig, ImageSwitcher &switcher)
+{
+  const int oldCount = oldConfig.paths.count();
+  const int newCount = newConfig.paths.count();
+  std::vector<int> reused(newCount, -1);
+  std::vector<bool> taken(oldCount, false);
+  for(int i = 0; i < newCount; ++i)
+  {
+    for(int j = 0; j < oldCount; ++j)
+    {
+      if (!taken[j] && newConfig.paths[i].sameSource(oldConfig.paths[j]))
+      {
+        reused[i] = j;
+        taken[j] = true;
+        break;
+      }
+    }
   }
 
-  if(appConfig.loadTime <  QFileInfo(jsonFile).lastModified())
+  // build the new entries before taking the selector lock, images keep coming from the old ones meanwhile
+  std::vector<std::shared_ptr<ImageLibrary>> libraries;
+  if(newCount > 1)
+  {
+    libraries = PrepareLibraries(newConfig);
+  }
+  std::vector<std::unique_ptr<ImageSelector>> selectors(newCount);
+  int rebuilt = 0;
+  for(int i = 0; i < newCount; ++i)
   {
-    AppConfig oldConfig = appConfig;
-    appConfig = loadAppConfiguration(appConfig);
+    if (reused[i] < 0)
+    {
+      selectors[i] = GetSelectorForConfig(newConfig.paths[i]);
+      ++rebuilt;
+    }
+  }
+  Log("Config reload: ", rebuilt, " of ", newCount, " path entries rebuilt");
 
-    ConfigureWindowFromSettings(w, appConfig);
-    if(appConfig.PathOptionsChanged(oldConfig))
+  switcher.updateImageSelector([&](std::unique_ptr<ImageSelector> &selector) {
+    for(int i = 0; i < newCount; ++i)
     {
-      std::unique_ptr<ImageSelector> selector = GetSelectorForApp(appConfig);
-      switcher->setImageSelector(selector);
+      if (reused[i] < 0)
+        continue;
+      if (oldCount == 1)
+        selectors[i] = std::move(selector);
+      else
+        selectors[i] = static_cast<ListImageSelector*>(selector.get())->takeImageSelector(reused[i]);
     }
+    selector = AssembleSelector(newConfig, selectors);
+  });
+}
+
+void ReloadConfig(const AppConfig &commandLineConfig, AppConfig &appConfig, MainWindow &w, ImageSwitcher &switcher)
+{
+  bool loaded = false;
+  AppConfig newConfig = loadAppConfiguration(commandLineConfig, &loaded);
+  if (!loaded || newConfig.paths.empty())
+  {
+    // most likely caught part way through being saved, there will be another change along
+    Log("Keeping the current config");
+    return;
+  }
 
-    switcher->setRotationTime(appConfig.rotationSeconds * 1000);
+  ConfigureWindowFromSettings(w, newConfig);
+  if(newConfig.PathOptionsChanged(appConfig))
+  {
+    UpdateSelectorForApp(appConfig, newConfig, switcher);
+  }
+  if(newConfig.rotationSeconds != appConfig.rotationSeconds)
+  {
+    switcher.setRotationTime(newConfig.rotationSeconds * 1000);
   }
+  if(newConfig.prefetchDepth != appConfig.prefetchDepth || newConfig.prefetchMemoryMB != appConfig.prefetchMemoryMB)
+  {
+    switcher.setPrefetch(newConfig.prefetchDepth, newConfig.prefetchMemoryMB);
+  }
+  appConfig = newConfig;
+}
+
+int RunHeadless(const AppConfig &appConfig)
+{
+  HeadlessSettings settings;
+  settings.screenSize = appConfig.headlessSize;
+  settings.frameCount = appConfig.headlessFrames;
+  settings.intervalMsec = appConfig.headlessIntervalMsec;
+  settings.frameDirectory = QString::fromStdString(appConfig.headlessFrameDirectory);
+  settings.frameCache = appConfig.headlessFrameCache;
+
+  // the same settings the window would render with
+  RenderSettings renderSettings;
+  renderSettings.screenSize = appConfig.headlessSize;
+  if (appConfig.blurRadius >= 0)
+    renderSettings.blurRadius = appConfig.blurRadius;
+  if (appConfig.backgroundOpacity >= 0)
+    renderSettings.backgroundOpacity = appConfig.backgroundOpacity;
+  renderSettings.blurDownscale = appConfig.blurDownscale;
+  renderSettings.decodeLimits.maxBytes = (quint64)appConfig.decodeMaxMB * 1024 * 1024;
+  renderSettings.decodeLimits.maxPixels = (quint64)appConfig.decodeMaxMegapixels * 1000000;
+  // a cached frame is a lookup, not a render, so leave the cache out of the numbers unless asked
+  if (appConfig.headlessFrameCache)
+    FrameCache::instance().setLimits(appConfig.frameCacheMB, appConfig.frameCacheMemoryMB);
+  else
+    FrameCache::instance().setLimits(0, 0);
+
+  std::unique_ptr<ImageSelector> selector = GetSelectorForApp(appConfig);
+  HeadlessRunner runner(settings, renderSettings, appConfig.baseDisplayOptions, selector);
+  runner.start();
+  return QCoreApplication::exec();
 }
 
 int main(int argc, char *argv[])
 {
+  // has to be decided before the application connects to a display
+  for (int arg = 1; arg < argc; ++arg)
+  {
+    const bool headless = strncmp(argv[arg], "--headless", 10) == 0 && (argv[arg][10] == '\0' || argv[arg][10] == '=');
+    if (headless && qgetenv("QT_QPA_PLATFORM").isEmpty())
+    {
+      qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+  }
   QApplication a(argc, argv);
 
   AppConfig commandLineAppConfig;
@@ -259,6 +442,24 @@ int main(int argc, char *argv[])
   SetupLogger(appConfig.debugMode);
   Log( "Rotation Time: ", appConfig.rotationSeconds );
   Log( "Overlay input: ", appConfig.overlay );
+
+  std::unique_ptr<MetricsWriter> metricsWriter;
+  if (!appConfig.metricsFile.empty())
+  {
+    metricsWriter = std::unique_ptr<MetricsWriter>(new MetricsWriter(appConfig.metricsFile, appConfig.metricsIntervalSeconds));
+  }
+
+  if (!appConfig.traceFile.empty())
+  {
+    Trace::instance().start(appConfig.traceFile, appConfig.traceSwitches);
+  }
+
+  if (appConfig.headlessSize.isValid())
+  {
+    const int result = RunHeadless(appConfig);
+    Trace::instance().finish();
+    return result;
+  }
   
   MainWindow w;
   ConfigureWindowFromSettings(w, appConfig);
@@ -267,9 +468,16 @@ int main(int argc, char *argv[])
   std::unique_ptr<ImageSelector> selector = GetSelectorForApp(appConfig);
   
   ImageSwitcher switcher(w, appConfig.rotationSeconds * 1000, selector);
+  switcher.setPrefetch(appConfig.prefetchDepth, appConfig.prefetchMemoryMB);
   w.setImageSwitcher(&switcher);
-  std::function<void(MainWindow &w, ImageSwitcher *switcher)> reloader = [&appConfig](MainWindow &w, ImageSwitcher *switcher) { ReloadConfigIfNeeded(appConfig, w, switcher); };
-  switcher.setConfigFileReloader(reloader);
+  std::unique_ptr<ConfigFileWatcher> configWatcher;
+  if(!appConfig.configPath.empty())
+  {
+    configWatcher = std::unique_ptr<ConfigFileWatcher>(new ConfigFileWatcher(appConfig.configPath));
+    QObject::connect(configWatcher.get(), &ConfigFileWatcher::changed, [&]() { ReloadConfig(commandLineAppConfig, appConfig, w, switcher); });
+  }
   switcher.start();
-  return a.exec();
+  const int result = a.exec();
+  Trace::instance().finish(); // a trace still recording when we quit is written now
+  return result;
 }
@@ -2,20 +2,16 @@
 #include "overlay.h"
 #include "ui_mainwindow.h"
 #include "imageswitcher.h"
+#include "imageprefetcher.h"
+#include "slideview.h"
 #include "logger.h"
-#include <QLabel>
+#include "trace.h"
 #include <QPixmap>
 #include <QBitmap>
 #include <QKeyEvent>
-#include <QGraphicsBlurEffect>
-#include <libexif/exif-data.h>
 #include <iostream>
-#include <QPainter>
 #include <QTimer>
-#include <QPropertyAnimation>
 #include <QRect>
-#include <QGraphicsScene>
-#include <QGraphicsPixmapItem>
 #include <QApplication>
 #include <QScreen>
 
@@ -43,9 +39,9 @@ MainWindow::MainWindow(QWidget *parent) :
     QCursor cursor = QCursor(bitmapBit, bitmapMsk, 0, 0);
     this->setCursor(cursor);
 
-    QLabel *label = this->findChild<QLabel*>("image");
-    setCentralWidget(label);
-    label->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
+    view = new SlideView(this);
+    view->setTransitionTime(transitionSeconds*1000);
+    setCentralWidget(view);
     update();
 
     QScreen* screen = QGuiApplication::primaryScreen();
@@ -131,7 +127,7 @@ bool MainWindow::event(QEvent* event)
 void MainWindow::resizeEvent(QResizeEvent* event)
 {
    QMainWindow::resizeEvent(event);
-   this->findChild<QLabel*>("image")->clear();
+   view->clear();
    updateImage();
 }
 
@@ -179,200 +175,65 @@ void MainWindow::checkWindowSize()
 void MainWindow::setImage(const ImageDetails &imageDetails)
 {
     currentImage = imageDetails;
+    currentFrame = QImage();
+    updateImage();
+}
+
+void MainWindow::setFrame(const PreparedFrame &frame)
+{
+    currentImage = frame.imageDetails;
+    currentFrame = frame.frame;
+    currentFrameSettings = frame.settings;
     updateImage();
 }
 
 void MainWindow::updateImage()
 {
+    TraceSpan span("MainWindow::updateImage");
     checkWindowSize();
     if (currentImage.filename == "")
       return;
 
-    QLabel *label = this->findChild<QLabel*>("image");
-    QPixmap oldImage = label->pixmap(Qt::ReturnByValue);
-    if (!oldImage.isNull() && transitionSeconds > 0)
+    // only compose here if nothing was prepared for us, or it was prepared for a different screen
+    const RenderSettings settings = getRenderSettings();
+    if (currentFrame.isNull() || currentFrameSettings != settings)
     {
-      QPalette palette;
-      palette.setBrush(QPalette::Window, oldImage);
-      this->setPalette(palette);
+      ImageRenderer renderer(settings);
+      currentFrame = renderer.render(currentImage);
+      currentFrameSettings = settings;
+      currentImage.image = QImage();
     }
-
-    QPixmap p;
-    p.load( currentImage.filename.c_str() );
-
-    Log("size:", p.width(), "x", p.height(), "(window:", width(), ",", height(), ")");
-
-    QPixmap rotated = getRotatedPixmap(p);
-    QPixmap scaled = getScaledPixmap(rotated);
-    QPixmap background = getBlurredBackground(rotated, scaled);
-    drawForeground(background, scaled);
-    
-    if (overlay != nullptr)
+    if (currentFrame.isNull())
     {
-      drawText(background, overlay->getMarginTopLeft(), overlay->getFontsizeTopLeft(), overlay->getRenderedTopLeft(currentImage.filename).c_str(), Qt::AlignTop|Qt::AlignLeft);
-      drawText(background, overlay->getMarginTopRight(), overlay->getFontsizeTopRight(), overlay->getRenderedTopRight(currentImage.filename).c_str(), Qt::AlignTop|Qt::AlignRight);
-      drawText(background, overlay->getMarginBottomLeft(), overlay->getFontsizeBottomLeft(), overlay->getRenderedBottomLeft(currentImage.filename).c_str(), Qt::AlignBottom|Qt::AlignLeft);
-      drawText(background, overlay->getMarginBottomRight(), overlay->getFontsizeBottomRight(), overlay->getRenderedBottomRight(currentImage.filename).c_str(), Qt::AlignBottom|Qt::AlignRight);
-      /*if (ShouldLog())
-      {
-        // draw a thumbnail version of the source image in the bottom left, to check for cropping issues
-        QPainter pt(&background);
-        QBrush brush(QColor(255, 255, 255, 255));
-        int margin = 10;
-        QPixmap thumbNail = p.scaledToWidth(200, Qt::SmoothTransformation);
-        pt.fillRect(background.width() - thumbNail.width() - 2*margin,
-                     background.height()-thumbNail.height() - 2*margin,
-                     thumbNail.width() +2*margin, thumbNail.height()+2*margin, brush);
-
-        pt.drawPixmap( background.width() - thumbNail.width() - margin,
-                     background.height()-thumbNail.height() - margin, 
-                     thumbNail);
-      }*/
-    }
-
-    label->setPixmap(background);
-
-    if (!oldImage.isNull() && transitionSeconds > 0)
-    {
-      auto effect = new QGraphicsOpacityEffect(label);
-      effect->setOpacity(0.0);
-      label->setGraphicsEffect(effect);
-      QPropertyAnimation* animation = new QPropertyAnimation(effect, "opacity");
-      animation->setDuration(transitionSeconds*1000);
-      animation->setStartValue(0);
-      animation->setEndValue(1);
-      animation->start(QAbstractAnimation::DeleteWhenStopped);
+      warn("Unable to load image.");
+      return;
     }
 
-    update();
-}
-
-void MainWindow::drawText(QPixmap& image, int margin, int fontsize, QString text, int alignment) {
-  QPainter pt(&image);
-  pt.setPen(QPen(QColor(overlayHexRGB)));
-  pt.setFont(QFont("Sans", fontsize, QFont::Bold));
-  QRect marginRect = image.rect().adjusted(
-      margin,
-      margin,
-      margin*-1,
-      margin*-1);
-  pt.drawText(marginRect, alignment, text);
-}
-
-void MainWindow::drawForeground(QPixmap& background, const QPixmap& foreground) {
-    QPainter pt(&background);
-    QBrush brush(QColor(0, 0, 0, 255-backgroundOpacity));
-    pt.fillRect(0,0,background.width(), background.height(), brush);
-    pt.drawPixmap((background.width()-foreground.width())/2, (background.height()-foreground.height())/2, foreground);
+    // the overlay is its own layer in the view, the frame itself is never drawn on
+    view->setOverlayImage(currentImage);
+    view->setFrame(currentFrame);
 }
 
 void MainWindow::setOverlay(std::unique_ptr<Overlay> &o)
 {
   overlay = std::move(o);
+  view->setOverlay(overlay.get());
 }
 
-QPixmap MainWindow::getBlurredBackground(const QPixmap& originalSize, const QPixmap& scaled)
-{
-    if (currentImage.options.fitAspectAxisToWindow) {
-      // our scaled version will just fill the whole screen, use it directly
-      //Log("Using scaled image");
-      QRect rect((scaled.width() - width())/2, 0, width(), height());
-      return scaled.copy(rect);
-    } else if (scaled.width() < width()) {
-      QPixmap background = blur(originalSize.scaledToWidth(width(), Qt::SmoothTransformation));
-      QRect rect(0, (background.height() - height())/2, width(), height());
-      return background.copy(rect);
-    } else {
-      // aspect 'p' or the image is not as wide as the screen
-      QPixmap background = blur(originalSize.scaledToHeight(height(), Qt::SmoothTransformation));
-      QRect rect((background.width() - width())/2, 0, width(), height());
-      return background.copy(rect);
-    }
-}
-
-QPixmap MainWindow::getRotatedPixmap(const QPixmap& p)
-{
-    QTransform transform;
-    transform.rotate(currentImage.rotation);
-    return p.transformed(transform);
-}
-
-QPixmap MainWindow::getScaledPixmap(const QPixmap& p)
-{
-  if (currentImage.options.fitAspectAxisToWindow)
-  {
-    bool stretchWidth = currentImage.aspect() == ImageAspect_Landscape;
-    bool stretchHeight = currentImage.aspect() == ImageAspect_Portrait;
-    // check the stretched image will naturally fill the screen for its aspect ratio
-    if (stretchHeight && (width() > ((double)height()/p.height())*p.width()))
-    {
-      // stretched via height won't fill the width, so stretch the other way
-      stretchHeight = false;
-      stretchWidth = true;
-    }
-    else if (stretchWidth && (height() > ((double)width()/p.width())*p.height()))
-    {
-      // stretched via width won't fill the width, so stretch the other way
-      stretchWidth = false;
-      stretchHeight = true;
-    }
-
-    if (stretchHeight)
-    {
-      // potrait mode, make height of image fit screen and crop top/bottom
-      QPixmap pTemp = p.scaledToHeight(height(), Qt::SmoothTransformation);
-      return pTemp.copy(0,0,width(),height());
-    }
-    else if (stretchWidth)
-    {
-      // landscape mode, make width of image fit screen and crop top/bottom
-      QPixmap pTemp = p.scaledToWidth(width(), Qt::SmoothTransformation);
-      return pTemp.copy(0,0,width(),height());
-    }
-  }
-
-  // just scale the best we can for the given photo
-  int w = width();
-  int h = height();
-  return p.scaled(w, h, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-}
-
-void MainWindow::drawBackground(const QPixmap& originalSize, const QPixmap& scaled)
+void MainWindow::setBlurRadius(unsigned int blurRadius)
 {
-    QPalette palette;
-    if (scaled.width() < width()) {
-        QPixmap background = blur(originalSize.scaledToHeight(height()));
-        QRect rect((background.width() - width())/2, 0, width(), height());
-        background = background.copy(rect);
-        palette.setBrush(QPalette::Window, background);
-    } else {
-        QPixmap background = blur(originalSize.scaledToHeight(height()));
-        QRect rect((background.width() - width())/2, 0, width(), height());
-        background = background.copy(rect);
-        palette.setBrush(QPalette::Window, background);
-    }
-    this->setPalette(palette);
+    this->blurRadius = blurRadius;
 }
 
-QPixmap MainWindow::blur(const QPixmap& input)
+void MainWindow::setBlurDownscale(unsigned int blurDownscale)
 {
-    QGraphicsScene scene;
-    QGraphicsPixmapItem item;
-    item.setPixmap(input);
-    QGraphicsBlurEffect effect;
-    effect.setBlurRadius(blurRadius);
-    item.setGraphicsEffect(&effect);
-    scene.addItem(&item);
-    QImage res(input.size(), QImage::Format_ARGB32);
-    res.fill(Qt::transparent);
-    QPainter ptr(&res);
-    scene.render(&ptr, QRectF(), QRectF( 0, 0, input.width(), input.height()) );
-    return QPixmap::fromImage(res);
+    this->blurDownscale = blurDownscale;
 }
 
-void MainWindow::setBlurRadius(unsigned int blurRadius)
+void MainWindow::setDecodeLimits(unsigned int maxMB, unsigned int maxMegapixels)
 {
-    this->blurRadius = blurRadius;
+    decodeLimits.maxBytes = (quint64)maxMB * 1024 * 1024;
+    decodeLimits.maxPixels = (quint64)maxMegapixels * 1000000;
 }
 
 void MainWindow::setBackgroundOpacity(unsigned int backgroundOpacity)
@@ -383,17 +244,23 @@ void MainWindow::setBackgroundOpacity(unsigned int backgroundOpacity)
 void MainWindow::setOverlayHexRGB(QString overlayHexRGB)
 {
     this->overlayHexRGB = overlayHexRGB;
+    view->setOverlayColor(QColor(overlayHexRGB));
 }
 
 void MainWindow::setTransitionTime(unsigned int transitionSeconds)
 {
     this->transitionSeconds = transitionSeconds;
+    view->setTransitionTime(transitionSeconds*1000);
+}
+
+void MainWindow::setTransitionFps(unsigned int fps)
+{
+    view->setTransitionFps(fps);
 }
 
 void MainWindow::warn(std::string text)
 {
-  QLabel *label = this->findChild<QLabel*>("image");
-  label->setText(text.c_str());
+  view->showMessage(QString::fromStdString(text));
 }
 
 void MainWindow::setBaseOptions(const ImageDisplayOptions &baseOptionsIn) 
@@ -417,3 +284,14 @@ const ImageDisplayOptions &MainWindow::getBaseOptions()
 {
    return baseImageOptions; 
 }
+
+RenderSettings MainWindow::getRenderSettings() const
+{
+  RenderSettings settings;
+  settings.screenSize = size();
+  settings.blurRadius = blurRadius;
+  settings.blurDownscale = blurDownscale;
+  settings.decodeLimits = decodeLimits;
+  settings.backgroundOpacity = backgroundOpacity;
+  return settings;
+}
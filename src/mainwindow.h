@@ -5,14 +5,16 @@
 #include <QPixmap>
 #include "imagestructs.h"
 #include "imageselector.h"
+#include "imagerenderer.h"
 
 namespace Ui {
 class MainWindow;
 }
-class QLabel;
+class SlideView;
 class QKeyEvent;
 class Overlay;
 class ImageSwitcher;
+struct PreparedFrame;
 
 class MainWindow : public QMainWindow
 {
@@ -25,13 +27,18 @@ public:
     void resizeEvent(QResizeEvent* event) override;
     ~MainWindow();
     void setImage(const ImageDetails &imageDetails);
+    void setFrame(const PreparedFrame &frame);
     void setBlurRadius(unsigned int blurRadius);
+    void setBlurDownscale(unsigned int blurDownscale);
+    void setDecodeLimits(unsigned int maxMB, unsigned int maxMegapixels);
     void setBackgroundOpacity(unsigned int opacity);
     void setTransitionTime(unsigned int transitionSeconds);
+    void setTransitionFps(unsigned int fps);
     void warn(std::string text);
     void setOverlay(std::unique_ptr<Overlay> &overlay);
     void setBaseOptions(const ImageDisplayOptions &baseOptionsIn);
     const ImageDisplayOptions &getBaseOptions();
+    RenderSettings getRenderSettings() const;
     void setImageSwitcher(ImageSwitcher *switcherIn);
     void setOverlayHexRGB(QString overlayHexRGB);
 public slots:
@@ -40,28 +47,23 @@ private:
     Ui::MainWindow *ui;
 
     unsigned int blurRadius = 20;
+    unsigned int blurDownscale = 4;
+    DecodeLimits decodeLimits;
     unsigned int backgroundOpacity = 150;
     ImageDisplayOptions baseImageOptions;
     bool imageAspectMatchesMonitor = false;
     ImageDetails currentImage;
+    QImage currentFrame;
+    RenderSettings currentFrameSettings;
     QSize lastScreenSize = {0,0};
     QString overlayHexRGB = "#FFFF";
     unsigned int transitionSeconds = 1;
 
+    SlideView *view = nullptr; // owned by the window as its central widget
     std::unique_ptr<Overlay> overlay;
     ImageSwitcher *switcher = nullptr;
 
-    void drawText(QPixmap& image, int margin, int fontsize, QString text, int alignment);
-
     void updateImage();
-    int getImageRotation();
-
-    QPixmap getBlurredBackground(const QPixmap& originalSize, const QPixmap& scaled);
-    QPixmap getRotatedPixmap(const QPixmap& p);
-    QPixmap getScaledPixmap(const QPixmap& p);
-    void drawBackground(const QPixmap& originalSize, const QPixmap& scaled);
-    void drawForeground(QPixmap& background, const QPixmap& foreground);
-    QPixmap blur(const QPixmap& input);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,492 @@
+#include "metadataindex.h"
+#include "logger.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+static const char indexMagic[4] = {'S','L','M','I'};
+static const quint32 indexVersion = 2;
+static const size_t minimumFlushCount = 256;
+static const int maxPendingSeconds = 30;
+
+// an exclusive flock held for as long as this lives
+class IndexLock
+{
+public:
+  IndexLock(const QString &path):
+    fd(::open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644))
+  {
+    if (fd >= 0 && ::flock(fd, LOCK_EX) != 0)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+  ~IndexLock()
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+  }
+  bool locked() const { return fd >= 0; }
+private:
+  int fd;
+};
+
+struct MetadataIndex::Header
+{
+    char magic[4];
+    quint32 version;
+    quint32 count;
+    quint32 reserved;
+};
+
+// records are sorted by pathHash, the UTF-8 paths and camera strings follow the record table
+struct MetadataIndex::Record
+{
+    quint64 pathHash;
+    qint64 fileSize;
+    qint64 modifiedTime;
+    qint64 captureTime;
+    qint64 thumbnailOffset;
+    qint32 width;
+    qint32 height;
+    qint32 orientation;
+    quint32 thumbnailLength;
+    quint32 pathOffset;
+    quint32 pathLength;
+    quint32 makeOffset;
+    quint32 makeLength;
+    quint32 modelOffset;
+    quint32 modelLength;
+};
+
+static quint64 hashPath(const char *path, size_t length)
+{
+  // 64 bit FNV-1a
+  quint64 hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; ++i)
+  {
+    hash ^= (unsigned char)path[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+MetadataIndex &MetadataIndex::instance()
+{
+  static MetadataIndex index;
+  return index;
+}
+
+MetadataIndex::MetadataIndex()
+{
+  static_assert(sizeof(Record) == 80, "index record layout changed, bump indexVersion");
+  QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation));
+  cacheDir.mkpath("slide");
+  indexPath = cacheDir.filePath("slide/metadata.idx");
+  mapIndex();
+  flusher = std::thread(&MetadataIndex::flushLoop, this);
+}
+
+MetadataIndex::~MetadataIndex()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  pendingChanged.notify_one();
+  flusher.join();
+  flush();
+  unmapIndex();
+}
+
+void MetadataIndex::flushLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopping)
+  {
+    if (pending.empty())
+    {
+      pendingChanged.wait(lock);
+      continue;
+    }
+    const auto due = oldestPending + std::chrono::seconds(maxPendingSeconds);
+    if (std::chrono::steady_clock::now() < due)
+    {
+      pendingChanged.wait_until(lock, due);
+      continue;
+    }
+    lock.unlock();
+    flush();
+    lock.lock();
+  }
+}
+
+void MetadataIndex::unmapIndex()
+{
+  if (mapped != nullptr)
+  {
+    indexFile.unmap(const_cast<uchar*>(mapped));
+  }
+  indexFile.close();
+  mapped = nullptr;
+  mappedSize = 0;
+  mappedCount = 0;
+}
+
+bool MetadataIndex::mapFile(const QString &path, QFile &file, const uchar *&data, qint64 &size, quint32 &count)
+{
+  file.setFileName(path);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return false; // no index yet
+  }
+  const qint64 fileSize = file.size();
+  if (fileSize < (qint64)sizeof(Header))
+  {
+    file.close();
+    return false;
+  }
+  const uchar *fileData = file.map(0, fileSize);
+  if (fileData == nullptr)
+  {
+    file.close();
+    return false;
+  }
+  const Header *header = reinterpret_cast<const Header*>(fileData);
+  if (memcmp(header->magic, indexMagic, sizeof(indexMagic)) != 0 || header->version != indexVersion ||
+      sizeof(Header) + (qint64)header->count * sizeof(Record) > (quint64)fileSize)
+  {
+    Log("Ignoring incompatible metadata index: ", path.toStdString());
+    file.unmap(const_cast<uchar*>(fileData));
+    file.close();
+    return false;
+  }
+  data = fileData;
+  size = fileSize;
+  count = header->count;
+  return true;
+}
+
+void MetadataIndex::mapIndex()
+{
+  unmapIndex();
+  if (mapFile(indexPath, indexFile, mapped, mappedSize, mappedCount))
+  {
+    Log("Loaded metadata index with ", mappedCount, " entries");
+  }
+}
+
+bool MetadataIndex::statFile(const std::string &fileName, ImageMetadata &metadata)
+{
+  QFileInfo info(QString::fromStdString(fileName));
+  if (!info.exists())
+  {
+    return false;
+  }
+  metadata.fileSize = info.size();
+  metadata.modifiedTime = info.lastModified().toMSecsSinceEpoch();
+  return true;
+}
+
+qint64 MetadataIndex::captureTimeFromExif(const QString &exifDateTime)
+{
+  QDateTime parsed = QDateTime::fromString(exifDateTime, "yyyy:MM:dd hh:mm:ss");
+  if (!parsed.isValid())
+  {
+    return -1;
+  }
+  // exif times have no zone, so keep the wall clock time as if it were UTC
+  return QDateTime(parsed.date(), parsed.time(), Qt::UTC).toMSecsSinceEpoch();
+}
+
+QDateTime MetadataIndex::captureDateTime(const ImageMetadata &metadata)
+{
+  if (metadata.captureTime < 0)
+  {
+    return QDateTime();
+  }
+  QDateTime wallClock = QDateTime::fromMSecsSinceEpoch(metadata.captureTime, Qt::UTC);
+  return QDateTime(wallClock.date(), wallClock.time());
+}
+
+bool MetadataIndex::lookupMapped(const std::string &fileName, ImageMetadata &metadata) const
+{
+  if (mapped == nullptr)
+  {
+    return false;
+  }
+  const quint64 hash = hashPath(fileName.data(), fileName.size());
+  const Record *begin = reinterpret_cast<const Record*>(mapped + sizeof(Header));
+  const Record *end = begin + mappedCount;
+  const Record *record = std::lower_bound(begin, end, hash, [](const Record &r, quint64 h) { return r.pathHash < h; });
+  for (; record != end && record->pathHash == hash; ++record)
+  {
+    if (record->pathLength != fileName.size() || (qint64)record->pathOffset + record->pathLength > mappedSize)
+    {
+      continue;
+    }
+    if (memcmp(mapped + record->pathOffset, fileName.data(), record->pathLength) != 0)
+    {
+      continue;
+    }
+    readRecord(mapped, mappedSize, *record, metadata);
+    return true;
+  }
+  return false;
+}
+
+QString MetadataIndex::mappedString(const uchar *data, qint64 size, quint32 offset, quint32 length)
+{
+  if (length == 0 || (qint64)offset + length > size)
+  {
+    return QString();
+  }
+  return QString::fromUtf8(reinterpret_cast<const char*>(data + offset), length);
+}
+
+void MetadataIndex::readRecord(const uchar *data, qint64 size, const Record &record, ImageMetadata &metadata)
+{
+  metadata.fileSize = record.fileSize;
+  metadata.modifiedTime = record.modifiedTime;
+  metadata.captureTime = record.captureTime;
+  metadata.width = record.width;
+  metadata.height = record.height;
+  metadata.orientation = record.orientation;
+  metadata.thumbnailOffset = record.thumbnailOffset;
+  metadata.thumbnailLength = record.thumbnailLength;
+  metadata.cameraMake = mappedString(data, size, record.makeOffset, record.makeLength);
+  metadata.cameraModel = mappedString(data, size, record.modelOffset, record.modelLength);
+}
+
+bool MetadataIndex::lookup(const std::string &fileName, ImageMetadata &metadata)
+{
+  ImageMetadata current;
+  if (!statFile(fileName, current))
+  {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  ImageMetadata found;
+  auto it = pending.find(fileName);
+  auto flushed = flushing.find(fileName);
+  if (it != pending.end())
+  {
+    found = it->second;
+  }
+  else if (flushed != flushing.end())
+  {
+    found = flushed->second;
+  }
+  else if (!lookupMapped(fileName, found))
+  {
+    return false;
+  }
+
+  // the file changed since we indexed it
+  if (found.fileSize != current.fileSize || found.modifiedTime != current.modifiedTime)
+  {
+    return false;
+  }
+  metadata = found;
+  return true;
+}
+
+bool MetadataIndex::peek(const std::string &fileName, ImageMetadata &metadata)
+{
+  // no stat of the file, so the answer may be stale; fine for hints, lookup() before trusting it
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = pending.find(fileName);
+  if (it != pending.end())
+  {
+    metadata = it->second;
+    return true;
+  }
+  auto flushed = flushing.find(fileName);
+  if (flushed != flushing.end())
+  {
+    metadata = flushed->second;
+    return true;
+  }
+  return lookupMapped(fileName, metadata);
+}
+
+void MetadataIndex::store(const std::string &fileName, const ImageMetadata &metadata)
+{
+  bool shouldFlush = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty())
+    {
+      oldestPending = std::chrono::steady_clock::now();
+      pendingChanged.notify_one();
+    }
+    pending[fileName] = metadata;
+    // grow the batch with the index so rewriting it stays amortised O(n). While a batch is
+    // being written this one waits for the next flush rather than the store for this one
+    shouldFlush = flushing.empty() && pending.size() >= std::max(minimumFlushCount, (size_t)mappedCount / 8);
+  }
+  if (shouldFlush)
+  {
+    flush();
+  }
+}
+
+void MetadataIndex::flush()
+{
+  std::lock_guard<std::mutex> flushLock(flushMutex);
+  {
+    // lookups carry on from flushing while the batch is merged and written
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty())
+    {
+      return;
+    }
+    flushing.swap(pending);
+  }
+
+  const bool written = writeIndex(flushing);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (written)
+  {
+    mapIndex();
+  }
+  else
+  {
+    // tried again with the next batch, or when the flusher next finds it due. Anything stored
+    // since is newer than what the batch has
+    for (const auto &item : flushing)
+    {
+      pending.emplace(item.first, item.second);
+    }
+    oldestPending = std::chrono::steady_clock::now();
+    pendingChanged.notify_one();
+  }
+  flushing.clear();
+}
+
+bool MetadataIndex::writeIndex(const std::unordered_map<std::string, ImageMetadata> &batch) const
+{
+  // other slide processes (a second screen, headless runs, the benchmarks) may share the index,
+  // so read, merge and replace it under a lock or the last rename drops what the others wrote
+  IndexLock indexLock(indexPath + ".lock");
+  if (!indexLock.locked())
+  {
+    Log("Unable to lock metadata index: ", indexPath.toStdString());
+    return false;
+  }
+
+  // pick up anything other slide processes wrote since we mapped the index. It's mapped
+  // again here rather than remapping the one lookups read, which needs the mutex
+  QFile currentFile;
+  const uchar *current = nullptr;
+  qint64 currentSize = 0;
+  quint32 currentCount = 0;
+  mapFile(indexPath, currentFile, current, currentSize, currentCount);
+
+  struct Entry
+  {
+    quint64 hash;
+    std::string path;
+    ImageMetadata metadata;
+  };
+  std::vector<Entry> entries;
+  entries.reserve(currentCount + batch.size());
+  if (current != nullptr)
+  {
+    const Record *records = reinterpret_cast<const Record*>(current + sizeof(Header));
+    for (quint32 i = 0; i < currentCount; ++i)
+    {
+      const Record &record = records[i];
+      if ((qint64)record.pathOffset + record.pathLength > currentSize)
+      {
+        continue;
+      }
+      std::string path(reinterpret_cast<const char*>(current + record.pathOffset), record.pathLength);
+      if (batch.count(path) > 0)
+      {
+        continue;
+      }
+      Entry entry;
+      entry.hash = record.pathHash;
+      entry.path = path;
+      readRecord(current, currentSize, record, entry.metadata);
+      entries.push_back(entry);
+    }
+    currentFile.unmap(const_cast<uchar*>(current));
+  }
+  currentFile.close();
+  for (const auto &item : batch)
+  {
+    entries.push_back({hashPath(item.first.data(), item.first.size()), item.first, item.second});
+  }
+  std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.hash < b.hash; });
+
+  QByteArray data;
+  Header header;
+  memcpy(header.magic, indexMagic, sizeof(indexMagic));
+  header.version = indexVersion;
+  header.count = (quint32)entries.size();
+  header.reserved = 0;
+  data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // strings go into one arena after the records, each record points at its pieces
+  QByteArray strings;
+  const quint32 stringsOffset = sizeof(Header) + entries.size() * sizeof(Record);
+  auto appendString = [&](const QByteArray &value, quint32 &offset, quint32 &length) {
+    offset = stringsOffset + strings.size();
+    length = (quint32)value.size();
+    strings.append(value);
+  };
+  for (const Entry &entry : entries)
+  {
+    Record record;
+    record.pathHash = entry.hash;
+    record.fileSize = entry.metadata.fileSize;
+    record.modifiedTime = entry.metadata.modifiedTime;
+    record.captureTime = entry.metadata.captureTime;
+    record.thumbnailOffset = entry.metadata.thumbnailOffset;
+    record.width = entry.metadata.width;
+    record.height = entry.metadata.height;
+    record.orientation = entry.metadata.orientation;
+    record.thumbnailLength = (quint32)entry.metadata.thumbnailLength;
+    appendString(QByteArray(entry.path.data(), (int)entry.path.size()), record.pathOffset, record.pathLength);
+    appendString(entry.metadata.cameraMake.toUtf8(), record.makeOffset, record.makeLength);
+    appendString(entry.metadata.cameraModel.toUtf8(), record.modelOffset, record.modelLength);
+    data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+  }
+  data.append(strings);
+
+  // write next to the index and rename over it, readers keep their old mapping until they remap.
+  // The data has to be on disk before the rename is, or a power cut can leave an empty index
+  const QString tempPath = indexPath + "." + QString::number(QCoreApplication::applicationPid());
+  QFile tempFile(tempPath);
+  if (!tempFile.open(QIODevice::WriteOnly | QIODevice::Truncate) || tempFile.write(data) != data.size() ||
+      !tempFile.flush() || ::fsync(tempFile.handle()) != 0)
+  {
+    Log("Failed to write metadata index: ", tempPath.toStdString());
+    tempFile.remove();
+    return false;
+  }
+  tempFile.close();
+  if (::rename(QFile::encodeName(tempPath).constData(), QFile::encodeName(indexPath).constData()) != 0)
+  {
+    Log("Failed to replace metadata index: ", indexPath.toStdString());
+    tempFile.remove();
+    return false;
+  }
+  return true;
+}
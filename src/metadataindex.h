@@ -0,0 +1,67 @@
+#ifndef METADATAINDEX_H
+#define METADATAINDEX_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QString>
+#include <QtGlobal>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "imagemetadata.h"
+
+// persistent index of image metadata, stored under ~/.cache/slide.
+// The index file is memory mapped read only and replaced atomically when new
+// entries are written, so several slide processes can share it. Writers merge
+// and replace it under a lock file so none drops what another wrote, without holding
+// up lookups while they do. New entries
+// are written in batches, and at the latest 30 seconds after they were added, so
+// a frame that is switched off rather than shut down loses little.
+class MetadataIndex
+{
+public:
+    static MetadataIndex &instance();
+    ~MetadataIndex();
+
+    bool lookup(const std::string &fileName, ImageMetadata &metadata);
+    bool peek(const std::string &fileName, ImageMetadata &metadata);
+    void store(const std::string &fileName, const ImageMetadata &metadata);
+    void flush();
+
+    static bool statFile(const std::string &fileName, ImageMetadata &metadata);
+    static qint64 captureTimeFromExif(const QString &exifDateTime);
+    static QDateTime captureDateTime(const ImageMetadata &metadata);
+
+private:
+    struct Header;
+    struct Record;
+
+    MetadataIndex();
+    static bool mapFile(const QString &path, QFile &file, const uchar *&data, qint64 &size, quint32 &count);
+    void mapIndex();
+    void unmapIndex();
+    bool lookupMapped(const std::string &fileName, ImageMetadata &metadata) const;
+    static QString mappedString(const uchar *data, qint64 size, quint32 offset, quint32 length);
+    static void readRecord(const uchar *data, qint64 size, const Record &record, ImageMetadata &metadata);
+    bool writeIndex(const std::unordered_map<std::string, ImageMetadata> &batch) const;
+    void flushLoop();
+
+    std::mutex mutex;
+    QString indexPath;
+    QFile indexFile;
+    const uchar *mapped = nullptr;
+    qint64 mappedSize = 0;
+    quint32 mappedCount = 0;
+    std::unordered_map<std::string, ImageMetadata> pending;
+    std::mutex flushMutex; // one flush at a time
+    std::unordered_map<std::string, ImageMetadata> flushing; // the batch being written, still looked up
+    std::chrono::steady_clock::time_point oldestPending; // when pending last went from empty to not
+    std::condition_variable pendingChanged;
+    bool stopping = false;
+    std::thread flusher; // writes pending entries that have waited too long
+};
+
+#endif // METADATAINDEX_H
@@ -0,0 +1,117 @@
+#include "metrics.h"
+#include <QTextStream>
+#include <algorithm>
+#include <vector>
+
+// everything is defined here, so the registries below are complete before main() runs
+static std::vector<StageHistogram*> &stageRegistry()
+{
+  static std::vector<StageHistogram*> stages;
+  return stages;
+}
+
+static std::vector<MetricCounter*> &counterRegistry()
+{
+  static std::vector<MetricCounter*> counters;
+  return counters;
+}
+
+static std::vector<MetricGauge*> &gaugeRegistry()
+{
+  static std::vector<MetricGauge*> gauges;
+  return gauges;
+}
+
+MetricCounter::MetricCounter(const char *name, const char *help):
+  name(name),
+  help(help)
+{
+  counterRegistry().push_back(this);
+}
+
+MetricGauge::MetricGauge(const char *name, const char *help):
+  name(name),
+  help(help)
+{
+  gaugeRegistry().push_back(this);
+}
+
+StageHistogram::StageHistogram(const char *stage):
+  stage(stage)
+{
+  stageRegistry().push_back(this);
+}
+
+void StageHistogram::observe(qint64 nsecs)
+{
+  const quint64 usecs = nsecs > 0 ? (quint64)nsecs / 1000 : 0;
+  // the first bucket whose limit (1 << index us) is above the duration, anything longer
+  // than the last limit is only in the count (the +Inf bucket)
+  const int index = usecs == 0 ? 0 : 64 - __builtin_clzll(usecs);
+  if (index < bucketCount)
+  {
+    buckets[index].fetch_add(1, std::memory_order_relaxed);
+  }
+  total.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(nsecs > 0 ? nsecs : 0, std::memory_order_relaxed);
+}
+
+namespace Metrics
+{
+  StageHistogram scan("scan");
+  StageHistogram select("select");
+  StageHistogram exif("exif");
+  StageHistogram decode("decode");
+  StageHistogram rotate("rotate");
+  StageHistogram scale("scale");
+  StageHistogram blur("blur");
+  StageHistogram composite("composite");
+  StageHistogram overlay("overlay");
+  StageHistogram transition("transition");
+
+  MetricCounter imagesSelected("slide_images_selected_total", "Images picked for display");
+  MetricCounter imagesRejected("slide_images_rejected_total", "Images skipped by a selector for their aspect, time window or a missing file");
+  MetricCounter frameCacheHits("slide_frame_cache_hits_total", "Composed frames found in the frame cache");
+  MetricCounter frameCacheMisses("slide_frame_cache_misses_total", "Composed frames that had to be rendered");
+  MetricCounter metadataIndexHits("slide_metadata_index_hits_total", "Image metadata found in the metadata index");
+  MetricCounter metadataIndexMisses("slide_metadata_index_misses_total", "Images that had to be probed for their metadata");
+  MetricGauge prefetchQueued("slide_prefetch_queued_frames", "Frames rendered ahead and waiting to be shown");
+
+  QString prometheusText()
+  {
+    QString text;
+    QTextStream out(&text);
+    out.setRealNumberPrecision(10);
+    out << "# HELP slide_stage_seconds Time spent in each stage of finding, preparing and showing an image\n";
+    out << "# TYPE slide_stage_seconds histogram\n";
+    for (const StageHistogram *histogram : stageRegistry())
+    {
+      // counts are read one at a time, so a scrape racing an update can be off by one; it is never negative
+      quint64 cumulative = 0;
+      for (int index = 0; index < StageHistogram::bucketCount; ++index)
+      {
+        cumulative += histogram->bucket(index);
+        out << "slide_stage_seconds_bucket{stage=\"" << histogram->stage << "\",le=\""
+            << StageHistogram::bucketLimitSeconds(index) << "\"} " << cumulative << "\n";
+      }
+      const quint64 count = std::max(cumulative, histogram->count());
+      out << "slide_stage_seconds_bucket{stage=\"" << histogram->stage << "\",le=\"+Inf\"} " << count << "\n";
+      out << "slide_stage_seconds_sum{stage=\"" << histogram->stage << "\"} " << histogram->sumNsecs() / 1e9 << "\n";
+      out << "slide_stage_seconds_count{stage=\"" << histogram->stage << "\"} " << count << "\n";
+    }
+    for (const MetricCounter *counter : counterRegistry())
+    {
+      out << "# HELP " << counter->name << " " << counter->help << "\n";
+      out << "# TYPE " << counter->name << " counter\n";
+      out << counter->name << " " << counter->get() << "\n";
+    }
+    for (const MetricGauge *gauge : gaugeRegistry())
+    {
+      out << "# HELP " << gauge->name << " " << gauge->help << "\n";
+      out << "# TYPE " << gauge->name << " gauge\n";
+      out << gauge->name << " " << gauge->get() << "\n";
+    }
+    out.flush();
+    return text;
+  }
+}
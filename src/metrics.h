@@ -0,0 +1,105 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QtGlobal>
+#include <QElapsedTimer>
+#include <atomic>
+#include "trace.h"
+
+// process wide counters and stage timings, cheap enough to leave on in production:
+// recording is one or two relaxed atomic adds and nothing is formatted until the
+// Prometheus text is asked for (see MetricsWriter)
+
+class MetricCounter
+{
+public:
+    MetricCounter(const char *name, const char *help);
+    void add(quint64 count = 1) { value.fetch_add(count, std::memory_order_relaxed); }
+    quint64 get() const { return value.load(std::memory_order_relaxed); }
+
+    const char *const name;
+    const char *const help;
+private:
+    std::atomic<quint64> value{0};
+};
+
+class MetricGauge
+{
+public:
+    MetricGauge(const char *name, const char *help);
+    void set(qint64 newValue) { value.store(newValue, std::memory_order_relaxed); }
+    qint64 get() const { return value.load(std::memory_order_relaxed); }
+
+    const char *const name;
+    const char *const help;
+private:
+    std::atomic<qint64> value{0};
+};
+
+// durations of one pipeline stage in power of two microsecond buckets, 1us to about a minute
+class StageHistogram
+{
+public:
+    static const int bucketCount = 27;
+
+    StageHistogram(const char *stage);
+    void observe(qint64 nsecs);
+    quint64 bucket(int index) const { return buckets[index].load(std::memory_order_relaxed); }
+    quint64 count() const { return total.load(std::memory_order_relaxed); }
+    quint64 sumNsecs() const { return sum.load(std::memory_order_relaxed); }
+    static double bucketLimitSeconds(int index) { return (double)(1ULL << index) / 1e6; }
+
+    const char *const stage;
+private:
+    std::atomic<quint64> buckets[bucketCount] = {};
+    std::atomic<quint64> total{0};
+    std::atomic<quint64> sum{0};
+};
+
+// times the enclosing scope into a stage, and into the trace when one is being recorded
+class StageTimer
+{
+public:
+    StageTimer(StageHistogram &histogram):
+      histogram(histogram), traceStart(Trace::instance().enabled() ? Trace::instance().now() : -1) { timer.start(); }
+    ~StageTimer()
+    {
+      const qint64 elapsed = timer.nsecsElapsed();
+      histogram.observe(elapsed);
+      if (traceStart >= 0)
+      {
+        Trace::instance().complete(histogram.stage, traceStart, elapsed);
+      }
+    }
+private:
+    StageHistogram &histogram;
+    const qint64 traceStart;
+    QElapsedTimer timer;
+};
+
+namespace Metrics
+{
+    extern StageHistogram scan;
+    extern StageHistogram select;
+    extern StageHistogram exif;
+    extern StageHistogram decode;
+    extern StageHistogram rotate;
+    extern StageHistogram scale;
+    extern StageHistogram blur;
+    extern StageHistogram composite;
+    extern StageHistogram overlay;
+    extern StageHistogram transition;
+
+    extern MetricCounter imagesSelected;
+    extern MetricCounter imagesRejected;
+    extern MetricCounter frameCacheHits;
+    extern MetricCounter frameCacheMisses;
+    extern MetricCounter metadataIndexHits;
+    extern MetricCounter metadataIndexMisses;
+    extern MetricGauge prefetchQueued;
+
+    QString prometheusText();
+}
+
+#endif // METRICS_H
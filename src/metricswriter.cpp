@@ -0,0 +1,41 @@
+#include "metricswriter.h"
+#include "metrics.h"
+#include "logger.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstdio>
+
+MetricsWriter::MetricsWriter(const std::string &pathIn, unsigned int intervalSeconds):
+  path(QFileInfo(QString::fromStdString(pathIn)).absoluteFilePath()),
+  timer(this)
+{
+  connect(&timer, SIGNAL(timeout()), this, SLOT(write()));
+  timer.start(std::max(1u, intervalSeconds) * 1000);
+  write();
+}
+
+MetricsWriter::~MetricsWriter()
+{
+  write();
+}
+
+void MetricsWriter::write()
+{
+  const QByteArray text = Metrics::prometheusText().toUtf8();
+  const QString tempPath = path + "." + QString::number(QCoreApplication::applicationPid());
+  QFile tempFile(tempPath);
+  if (!tempFile.open(QIODevice::WriteOnly | QIODevice::Truncate) || tempFile.write(text) != text.size())
+  {
+    Log("Failed to write metrics: ", tempPath.toStdString());
+    tempFile.remove();
+    return;
+  }
+  tempFile.close();
+  if (::rename(QFile::encodeName(tempPath).constData(), QFile::encodeName(path).constData()) != 0)
+  {
+    Log("Failed to replace metrics: ", path.toStdString());
+    tempFile.remove();
+  }
+}
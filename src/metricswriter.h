@@ -0,0 +1,26 @@
+#ifndef METRICSWRITER_H
+#define METRICSWRITER_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+// rewrites the metrics as a Prometheus text file every few seconds, for node_exporter's
+// textfile collector or anything else that can read a file. Each write goes next to the
+// file and is renamed over it, so a reader never sees half of one.
+class MetricsWriter : public QObject
+{
+    Q_OBJECT
+public:
+    MetricsWriter(const std::string &path, unsigned int intervalSeconds);
+    virtual ~MetricsWriter();
+
+private slots:
+    void write();
+
+private:
+    const QString path;
+    QTimer timer;
+};
+
+#endif // METRICSWRITER_H
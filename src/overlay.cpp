@@ -1,8 +1,8 @@
 #include "overlay.h"
 #include "logger.h"
+#include "metadataindex.h"
 #include <QString>
 #include <QDateTime>
-#include <libexif/exif-data.h>
 #include <unistd.h>
 #include <QDate>
 #include <QLocale>
@@ -22,31 +22,65 @@ Overlay::~Overlay() {}
 
 void Overlay::parseInput() {
   QString str = QString(overlayInput.c_str());
-  QStringList corners = str.split(QLatin1Char(';'));
-  if (corners.size() > 0) {
-    QStringList components = getOverlayComponents(corners[0]);
-    topLeftTemplate = getTemplate(components);
-    topLeftMargin = getMargin(components);
-    topLeftFontsize = getFontsize(components);
+  QStringList cornerInputs = str.split(QLatin1Char(';'));
+  for (int corner = 0; corner < OverlayCorner_Count && corner < cornerInputs.size(); ++corner) {
+    QStringList components = getOverlayComponents(cornerInputs[corner]);
+    corners[corner].tokens = compileTemplate(getTemplate(components));
+    corners[corner].margin = getMargin(components);
+    corners[corner].fontsize = getFontsize(components);
   }
-  if (corners.size() > 1) {
-    QStringList components = getOverlayComponents(corners[1]);
-    topRightTemplate = getTemplate(components);
-    topRightMargin = getMargin(components);
-    topRightFontsize = getFontsize(components);
-  }
-  if (corners.size() > 2) {
-    QStringList components = getOverlayComponents(corners[2]);
-    bottomLeftTemplate = getTemplate(components);
-    bottomLeftMargin = getMargin(components);
-    bottomLeftFontsize = getFontsize(components);
+}
+
+// splits the template into literal text and tokens, so rendering never has to search the string
+QVector<OverlayToken> Overlay::compileTemplate(const QString &overlayTemplate) {
+  static const struct { const char *name; OverlayTokenType type; } tokenNames[] = {
+    {"<datetime>", OverlayToken_DateTime},
+    {"<date>", OverlayToken_Date},
+    {"<time>", OverlayToken_Time},
+    {"<dir>", OverlayToken_Dir},
+    {"<path>", OverlayToken_Path},
+    {"<filepath>", OverlayToken_FilePath},
+    {"<filename>", OverlayToken_Filename},
+    {"<basename>", OverlayToken_Basename},
+    {"<exifdatetime>", OverlayToken_ExifDateTime},
+    {"<camera>", OverlayToken_Camera},
+  };
+
+  QVector<OverlayToken> tokens;
+  QString text;
+  int pos = 0;
+  while (pos < overlayTemplate.size()) {
+    bool matched = false;
+    if (overlayTemplate[pos] == QLatin1Char('<')) {
+      for (const auto &tokenName : tokenNames) {
+        const QLatin1String name(tokenName.name);
+        if (overlayTemplate.midRef(pos, name.size()) == name) {
+          if (!text.isEmpty()) {
+            OverlayToken literal;
+            literal.text = text;
+            tokens.append(literal);
+            text.clear();
+          }
+          OverlayToken token;
+          token.type = tokenName.type;
+          tokens.append(token);
+          pos += name.size();
+          matched = true;
+          break;
+        }
+      }
+    }
+    if (!matched) {
+      text.append(overlayTemplate[pos]);
+      ++pos;
+    }
   }
-  if (corners.size() > 3) {
-    QStringList components = getOverlayComponents(corners[3]);
-    bottomRightTemplate = getTemplate(components);
-    bottomRightMargin = getMargin(components);
-    bottomRightFontsize = getFontsize(components);
+  if (!text.isEmpty()) {
+    OverlayToken literal;
+    literal.text = text;
+    tokens.append(literal);
   }
+  return tokens;
 }
 
 QString Overlay::getTemplate(QStringList components){
@@ -92,79 +126,122 @@ QStringList Overlay::getOverlayComponents(QString corner) {
   return malformed;
 }
 
-std::string Overlay::getRenderedTopLeft(std::string filename) {
-  return renderString(topLeftTemplate, filename);
-}
-std::string Overlay::getRenderedTopRight(std::string filename) {
-  return renderString(topRightTemplate, filename);
+bool Overlay::isTimeToken(OverlayTokenType type) {
+  return type == OverlayToken_DateTime || type == OverlayToken_Date || type == OverlayToken_Time;
 }
-std::string Overlay::getRenderedBottomLeft(std::string filename) {
-  return renderString(bottomLeftTemplate, filename);
-}
-std::string Overlay::getRenderedBottomRight(std::string filename) {
-  return renderString(bottomRightTemplate, filename);
-}
-
-int Overlay::getMarginTopLeft() {return topLeftMargin;}
-int Overlay::getFontsizeTopLeft() {return topLeftFontsize;}
-int Overlay::getMarginTopRight() {return topRightMargin;}
-int Overlay::getFontsizeTopRight() {return topRightFontsize;}
-int Overlay::getMarginBottomLeft() {return bottomLeftMargin;}
-int Overlay::getFontsizeBottomLeft() {return bottomLeftFontsize;}
-int Overlay::getMarginBottomRight() {return bottomRightMargin;}
-int Overlay::getFontsizeBottomRight() {return bottomRightFontsize;}
 
-std::string Overlay::renderString(QString overlayTemplate, std::string filename) {
-  QString result = overlayTemplate;
-  result.replace("<datetime>", QLocale::system().toString(QDateTime::currentDateTime()));
-  result.replace("<date>", QLocale::system().toString(QDate::currentDate()));
-  result.replace("<time>", QTime::currentTime().toString("hh:mm"));
-  result.replace("<dir>", getDir(filename));
-  result.replace("<path>", getPath(filename));
-  result.replace("<filepath>", filename.c_str());
-  result.replace("<filename>", getFilename(filename));
-  result.replace("<basename>", getBasename(filename));
-  result.replace("<exifdatetime>", getExifDate(filename));
-  return result.toStdString();
+bool Overlay::usesToken(OverlayTokenType type) const {
+  for (const CornerTemplate &corner : corners) {
+    for (const OverlayToken &token : corner.tokens) {
+      if (token.type == type)
+        return true;
+    }
+  }
+  return false;
 }
 
-QString Overlay::getFilename(std::string filename) {
-  QFileInfo fileInfo(filename.c_str());
-  return fileInfo.fileName();
+bool Overlay::hasTimeTokens() const {
+  return usesToken(OverlayToken_DateTime) || usesToken(OverlayToken_Date) || usesToken(OverlayToken_Time);
 }
 
-QString Overlay::getBasename(std::string filename) {
-  QFileInfo fileInfo(filename.c_str());
-  return fileInfo.baseName();
+bool Overlay::hasSecondsTokens() const {
+  // the locale's long date time format includes seconds
+  return usesToken(OverlayToken_DateTime);
 }
 
-QString Overlay::getDir(std::string filename) {
-  QFileInfo fileInfo(filename.c_str());
-  return fileInfo.dir().dirName();
+QStringList Overlay::renderCorners(const ImageDetails &imageDetails) {
+  const std::string &filename = imageDetails.filename;
+  if (filename != cachedFilename) {
+    cachedFilename = filename;
+    for (bool &evaluated : cachedEvaluated)
+      evaluated = false;
+  }
+  const QFileInfo fileInfo(QString::fromStdString(filename));
+
+  QStringList rendered;
+  for (const CornerTemplate &corner : corners) {
+    QString result;
+    for (const OverlayToken &token : corner.tokens) {
+      if (token.type == OverlayToken_Text) {
+        result += token.text;
+        continue;
+      }
+      if (!cachedEvaluated[token.type]) {
+        cachedValues[token.type] = evaluateToken(token.type, imageDetails, fileInfo);
+        cachedEvaluated[token.type] = true;
+      }
+      result += cachedValues[token.type];
+    }
+    rendered.append(result);
+  }
+  // the clock moves on, everything else stays valid until the image changes
+  for (int type = 0; type < OverlayToken_Count; ++type) {
+    if (isTimeToken((OverlayTokenType)type))
+      cachedEvaluated[type] = false;
+  }
+  return rendered;
+}
+
+QString Overlay::evaluateToken(OverlayTokenType type, const ImageDetails &imageDetails, const QFileInfo &fileInfo) {
+  switch (type) {
+    case OverlayToken_DateTime:
+      return QLocale::system().toString(QDateTime::currentDateTime());
+    case OverlayToken_Date:
+      return QLocale::system().toString(QDate::currentDate());
+    case OverlayToken_Time:
+      return QTime::currentTime().toString("hh:mm");
+    case OverlayToken_Dir:
+      return fileInfo.dir().dirName();
+    case OverlayToken_Path:
+      return fileInfo.path();
+    case OverlayToken_FilePath:
+      return QString::fromStdString(imageDetails.filename);
+    case OverlayToken_Filename:
+      return fileInfo.fileName();
+    case OverlayToken_Basename:
+      return fileInfo.baseName();
+    case OverlayToken_ExifDateTime:
+      return getExifDate(imageDetails);
+    case OverlayToken_Camera:
+      return getCamera(imageDetails);
+    default:
+      return QString();
+  }
 }
 
-QString Overlay::getPath(std::string filename) {
-  QFileInfo fileInfo(filename.c_str());
-  return fileInfo.path();
+int Overlay::getMarginTopLeft() {return corners[OverlayCorner_TopLeft].margin;}
+int Overlay::getFontsizeTopLeft() {return corners[OverlayCorner_TopLeft].fontsize;}
+int Overlay::getMarginTopRight() {return corners[OverlayCorner_TopRight].margin;}
+int Overlay::getFontsizeTopRight() {return corners[OverlayCorner_TopRight].fontsize;}
+int Overlay::getMarginBottomLeft() {return corners[OverlayCorner_BottomLeft].margin;}
+int Overlay::getFontsizeBottomLeft() {return corners[OverlayCorner_BottomLeft].fontsize;}
+int Overlay::getMarginBottomRight() {return corners[OverlayCorner_BottomRight].margin;}
+int Overlay::getFontsizeBottomRight() {return corners[OverlayCorner_BottomRight].fontsize;}
+
+ImageMetadata Overlay::getMetadata(const ImageDetails &imageDetails) {
+  // the selector already parsed it, only images that didn't come through it need a lookup
+  ImageMetadata metadata = imageDetails.metadata;
+  if (metadata.fileSize <= 0 && !MetadataIndex::instance().lookup(imageDetails.filename, metadata))
+  {
+    ReadImageMetadata(imageDetails.filename, metadata);
+  }
+  return metadata;
 }
 
-QString Overlay::getExifDate(std::string filename) {
+QString Overlay::getExifDate(const ImageDetails &imageDetails) {
+  return QLocale::system().toString(MetadataIndex::captureDateTime(getMetadata(imageDetails)));
+}
 
-  QString dateTime;
-  ExifData *exifData = exif_data_new_from_file(filename.c_str());
-  if (exifData)
+QString Overlay::getCamera(const ImageDetails &imageDetails) {
+  const ImageMetadata metadata = getMetadata(imageDetails);
+  // most models already start with the make, e.g. "Canon" + "Canon EOS 80D"
+  if (metadata.cameraMake.isEmpty() || metadata.cameraModel.startsWith(metadata.cameraMake, Qt::CaseInsensitive))
   {
-    ExifEntry *exifEntry = exif_data_get_entry(exifData, EXIF_TAG_DATE_TIME_ORIGINAL);
-
-    if (exifEntry)
-    {
-      char buf[2048];
-      dateTime = exif_entry_get_value(exifEntry, buf, sizeof(buf));
-    }
-    exif_data_free(exifData);
-    QString exifDateFormat = "yyyy:MM:dd hh:mm:ss";
-    QDateTime exifDateTime = QDateTime::fromString(dateTime, exifDateFormat);
-    return QLocale::system().toString(exifDateTime);
+    return metadata.cameraModel;
+  }
+  if (metadata.cameraModel.isEmpty())
+  {
+    return metadata.cameraMake;
   }
-  return dateTime;
+  return metadata.cameraMake + " " + metadata.cameraModel;
 }
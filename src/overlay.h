@@ -3,20 +3,57 @@
 
 #include <iostream>
 #include <QDir>
-#include <iostream>
 #include <QString>
 #include <QStringList>
+#include <QVector>
+#include "imagestructs.h"
 
 class MainWindow;
+class QFileInfo;
+
+// the pieces an overlay template is compiled into, literal text or a token to fill in
+enum OverlayTokenType
+{
+  OverlayToken_Text,
+  OverlayToken_DateTime,
+  OverlayToken_Date,
+  OverlayToken_Time,
+  OverlayToken_Dir,
+  OverlayToken_Path,
+  OverlayToken_FilePath,
+  OverlayToken_Filename,
+  OverlayToken_Basename,
+  OverlayToken_ExifDateTime,
+  OverlayToken_Camera,
+  OverlayToken_Count
+};
+
+struct OverlayToken
+{
+  OverlayTokenType type = OverlayToken_Text;
+  QString text; // only for OverlayToken_Text
+};
+
+enum OverlayCorner
+{
+  OverlayCorner_TopLeft,
+  OverlayCorner_TopRight,
+  OverlayCorner_BottomLeft,
+  OverlayCorner_BottomRight,
+  OverlayCorner_Count
+};
+
 class Overlay
 {
   public:
     Overlay(const std::string path);
     virtual ~Overlay();
-    std::string getRenderedTopLeft(std::string filename);
-    std::string getRenderedTopRight(std::string filename);
-    std::string getRenderedBottomLeft(std::string filename);
-    std::string getRenderedBottomRight(std::string filename);
+    // renders all four corners, in OverlayCorner order. Each token used is evaluated
+    // once for the image no matter how many corners use it, and only the clock tokens
+    // are evaluated again when the same image is rendered a second time
+    QStringList renderCorners(const ImageDetails &imageDetails);
+    bool hasTimeTokens() const;
+    bool hasSecondsTokens() const;
 
     int getMarginTopLeft();
     int getFontsizeTopLeft();
@@ -28,36 +65,32 @@ class Overlay
     int getFontsizeBottomRight();
 
   private:
-    const std::string overlayInput;
-    int margin;
-    int fontsize;
-
-    QString topLeftTemplate;
-    QString topRightTemplate;
-    QString bottomLeftTemplate;
-    QString bottomRightTemplate;
+    struct CornerTemplate
+    {
+      QVector<OverlayToken> tokens;
+      int margin = 20;
+      int fontsize = 12;
+    };
 
-    int topLeftMargin;
-    int topRightMargin;
-    int bottomLeftMargin;
-    int bottomRightMargin;
+    const std::string overlayInput;
+    CornerTemplate corners[OverlayCorner_Count];
 
-    int topLeftFontsize;
-    int topRightFontsize;
-    int bottomLeftFontsize;
-    int bottomRightFontsize;
+    std::string cachedFilename;
+    QString cachedValues[OverlayToken_Count];
+    bool cachedEvaluated[OverlayToken_Count] = {};
 
     QStringList getOverlayComponents(QString corner);
     int getMargin(QStringList components);
     int getFontsize(QStringList components);
     QString getTemplate(QStringList components);
+    QVector<OverlayToken> compileTemplate(const QString &overlayTemplate);
+    static bool isTimeToken(OverlayTokenType type);
+    bool usesToken(OverlayTokenType type) const;
+    QString evaluateToken(OverlayTokenType type, const ImageDetails &imageDetails, const QFileInfo &fileInfo);
 
-    QString getExifDate(std::string filename);
-    QString getDir(std::string filename);
-    QString getPath(std::string filename);
-    QString getFilename(std::string filename);
-    QString getBasename(std::string filename);
+    ImageMetadata getMetadata(const ImageDetails &imageDetails);
+    QString getExifDate(const ImageDetails &imageDetails);
+    QString getCamera(const ImageDetails &imageDetails);
     void parseInput();
-    std::string renderString(QString overlayTemplate, std::string filename);
 };
 #endif
@@ -0,0 +1,212 @@
+#include "pathstore.h"
+#include <algorithm>
+#include <cstring>
+
+const quint32 PathStore::invalidId;
+
+// below this the arena isn't worth rewriting however much of it is dead
+static const size_t minimumCompactBytes = 64 * 1024;
+
+quint32 PathStore::intern(const QByteArray &name)
+{
+  const quint32 offset = (quint32)names.size();
+  names.insert(names.end(), name.constData(), name.constData() + name.size());
+  names.push_back('\0');
+  return offset;
+}
+
+quint32 PathStore::addDirectory(quint32 parent, const QString &name)
+{
+  Directory directory;
+  directory.parent = parent;
+  directory.nameOffset = intern(name.toUtf8());
+  directory.removed = false;
+  directories.push_back(directory);
+  return (quint32)directories.size() - 1;
+}
+
+void PathStore::removeDirectory(quint32 directory)
+{
+  Directory &removed = directories[directory];
+  if (removed.removed)
+  {
+    return;
+  }
+  for (quint32 image : removed.images)
+  {
+    deadNameBytes += strlen(&names[images[image].nameOffset]) + 1;
+    images[image].directory = invalidId;
+    --liveImages;
+  }
+  // the entry itself stays so ids of other directories don't move
+  std::vector<quint32>().swap(removed.images);
+  removed.removed = true;
+  ++removedDirectories;
+  deadNameBytes += strlen(&names[removed.nameOffset]) + 1;
+  compactIfWasteful();
+}
+
+quint32 PathStore::addImage(quint32 directory, const QString &name)
+{
+  Image image;
+  image.directory = directory;
+  image.nameOffset = intern(name.toUtf8());
+  image.slot = (quint32)directories[directory].images.size();
+  images.push_back(image);
+  const quint32 id = (quint32)images.size() - 1;
+  directories[directory].images.push_back(id);
+  ++liveImages;
+  return id;
+}
+
+void PathStore::removeImage(quint32 image)
+{
+  if (!isLive(image))
+  {
+    return;
+  }
+  // swap remove, a folder's images have no order to keep
+  std::vector<quint32> &siblings = directories[images[image].directory].images;
+  const quint32 slot = images[image].slot;
+  siblings[slot] = siblings.back();
+  images[siblings[slot]].slot = slot;
+  siblings.pop_back();
+  deadNameBytes += strlen(&names[images[image].nameOffset]) + 1;
+  images[image].directory = invalidId;
+  --liveImages;
+  compactIfWasteful();
+}
+
+bool PathStore::isLive(quint32 image) const
+{
+  return image < images.size() && images[image].directory != invalidId;
+}
+
+const std::vector<quint32> &PathStore::imagesIn(quint32 directory) const
+{
+  return directories[directory].images;
+}
+
+const char *PathStore::imageName(quint32 image) const
+{
+  return &names[images[image].nameOffset];
+}
+
+std::string PathStore::directoryPath(quint32 directory) const
+{
+  // walk up to the root, then join the names back down
+  std::vector<quint32> chain;
+  for (quint32 current = directory; current != invalidId; current = directories[current].parent)
+  {
+    chain.push_back(current);
+  }
+  std::string path;
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+  {
+    if (!path.empty() && path.back() != '/')
+    {
+      path += '/';
+    }
+    path += &names[directories[*it].nameOffset];
+  }
+  return path;
+}
+
+std::string PathStore::imagePath(quint32 image) const
+{
+  if (!isLive(image))
+  {
+    return std::string();
+  }
+  std::string path = directoryPath(images[image].directory);
+  if (path.empty() || path.back() != '/')
+  {
+    path += '/';
+  }
+  path += imageName(image);
+  return path;
+}
+
+void PathStore::compactIfWasteful()
+{
+  // ids stay as they are, only the names of removed entries are dropped from the arena
+  if (names.size() < minimumCompactBytes || deadNameBytes < names.size() / 2)
+  {
+    return;
+  }
+  std::vector<char> live;
+  live.reserve(names.size() - deadNameBytes);
+  auto move = [&](quint32 &offset) {
+    const char *name = &names[offset];
+    offset = (quint32)live.size();
+    live.insert(live.end(), name, name + strlen(name) + 1);
+  };
+  for (Directory &directory : directories)
+  {
+    if (!directory.removed)
+      move(directory.nameOffset);
+  }
+  for (Image &image : images)
+  {
+    if (image.directory != invalidId)
+      move(image.nameOffset);
+  }
+  names.swap(live);
+  deadNameBytes = 0;
+}
+
+std::vector<quint32> PathStore::compactIds()
+{
+  std::vector<quint32> directoryIds(directories.size(), invalidId);
+  quint32 nextDirectory = 0;
+  for (size_t directory = 0; directory < directories.size(); ++directory)
+  {
+    if (!directories[directory].removed)
+      directoryIds[directory] = nextDirectory++;
+  }
+
+  std::vector<char> liveNames;
+  liveNames.reserve(names.size() - deadNameBytes);
+  auto copyName = [&](quint32 offset) {
+    const char *name = &names[offset];
+    const quint32 copied = (quint32)liveNames.size();
+    liveNames.insert(liveNames.end(), name, name + strlen(name) + 1);
+    return copied;
+  };
+
+  std::vector<Directory> liveDirectories;
+  liveDirectories.reserve(nextDirectory);
+  for (const Directory &directory : directories)
+  {
+    if (directory.removed)
+      continue;
+    Directory moved;
+    // a folder is removed together with everything below it, so a live one has a live parent
+    moved.parent = directory.parent == invalidId ? invalidId : directoryIds[directory.parent];
+    moved.nameOffset = copyName(directory.nameOffset);
+    moved.removed = false;
+    liveDirectories.push_back(moved);
+  }
+
+  std::vector<Image> liveImageList;
+  liveImageList.reserve(liveImages);
+  for (const Image &image : images)
+  {
+    if (image.directory == invalidId)
+      continue;
+    Image moved;
+    moved.directory = directoryIds[image.directory];
+    moved.nameOffset = copyName(image.nameOffset);
+    std::vector<quint32> &siblings = liveDirectories[moved.directory].images;
+    moved.slot = (quint32)siblings.size();
+    siblings.push_back((quint32)liveImageList.size());
+    liveImageList.push_back(moved);
+  }
+
+  names.swap(liveNames);
+  directories.swap(liveDirectories);
+  images.swap(liveImageList);
+  deadNameBytes = 0;
+  removedDirectories = 0;
+  return directoryIds;
+}
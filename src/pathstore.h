@@ -0,0 +1,63 @@
+#ifndef PATHSTORE_H
+#define PATHSTORE_H
+
+#include <QString>
+#include <QtGlobal>
+#include <string>
+#include <vector>
+
+// image paths interned as a tree of folders over one arena of UTF-8 names, so a library
+// costs about its unique path bytes plus a dozen bytes an image. Images are addressed by
+// 32 bit ids that don't move: new images get new ids and removed ones leave a tombstone,
+// so anything holding ids only has to skip the dead ones. Once the owner decides there are
+// too many tombstones, compactIds() renumbers everything densely. Not thread safe, the owner locks.
+class PathStore
+{
+public:
+    static const quint32 invalidId = 0xffffffff;
+
+    // parent is invalidId for a root, whose name is then its absolute path
+    quint32 addDirectory(quint32 parent, const QString &name);
+    void removeDirectory(quint32 directory);
+    quint32 addImage(quint32 directory, const QString &name);
+    void removeImage(quint32 image);
+
+    quint32 imageIdCount() const { return (quint32)images.size(); }
+    quint32 liveImageCount() const { return liveImages; }
+    quint32 deadIdCount() const { return (quint32)images.size() - liveImages + removedDirectories; }
+    bool isLive(quint32 image) const;
+    quint32 imageDirectory(quint32 image) const { return images[image].directory; }
+    const std::vector<quint32> &imagesIn(quint32 directory) const;
+    const char *imageName(quint32 image) const;
+    std::string imagePath(quint32 image) const;
+    std::string directoryPath(quint32 directory) const;
+    // drops removed images and directories and renumbers the rest in their current order.
+    // Returns the new id of every old directory id, invalidId for removed ones
+    std::vector<quint32> compactIds();
+
+private:
+    struct Directory
+    {
+        quint32 parent;
+        quint32 nameOffset;
+        bool removed;
+        std::vector<quint32> images; // live images, in no particular order
+    };
+    struct Image
+    {
+        quint32 directory; // invalidId once removed
+        quint32 nameOffset;
+        quint32 slot; // where it is in its directory's images, so removing it is O(1)
+    };
+    quint32 intern(const QByteArray &name);
+    void compactIfWasteful();
+
+    std::vector<char> names; // NUL terminated UTF-8 names of every directory and image
+    size_t deadNameBytes = 0;
+    std::vector<Directory> directories;
+    std::vector<Image> images;
+    quint32 liveImages = 0;
+    quint32 removedDirectories = 0;
+};
+
+#endif // PATHSTORE_H
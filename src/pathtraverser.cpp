@@ -2,6 +2,10 @@
 #include "mainwindow.h"
 #include "appconfig.h"
 #include "logger.h"
+#include "imagelibrary.h"
+#include "imagelistfile.h"
+#include "libraryregistry.h"
+#include "folderoptionscache.h"
 
 #include <QDirIterator>
 #include <QDir>
@@ -11,27 +15,58 @@
 
 
 PathTraverser::PathTraverser(const std::string path):
-  path(path)
+  path(path),
+  rootPath(QDir(QString::fromStdString(path)).absolutePath())
 {}
 
 PathTraverser::~PathTraverser() {}
 
-QStringList PathTraverser::getImageFormats() const {
+QStringList PathTraverser::getImageFormats() {
   QStringList imageFormats;
   for ( const QString& s : supportedFormats )
       imageFormats<<"*."+s<<"*."+s.toUpper();
   return imageFormats;
 }
 
-ImageDisplayOptions PathTraverser::LoadOptionsForDirectory(const std::string &directoryPath, const ImageDisplayOptions &baseOptions) const
+const std::string &PathTraverser::getPath() const
 {
-  Config baseConfig;
-  baseConfig.baseDisplayOptions = baseOptions;
-  return getConfigurationForFolder(directoryPath, baseConfig).baseDisplayOptions;
+  return path;
+}
+
+quint64 PathTraverser::getGeneration() const
+{
+  return 0;
+}
+
+quint64 PathTraverser::getIdLayout() const
+{
+  return 0;
+}
+
+int PathTraverser::getImageCount() const
+{
+  return getImages().size();
+}
+
+std::string PathTraverser::getImageAt(int index) const
+{
+  // the lists are implicitly shared, so this doesn't copy them
+  const QStringList images = getImages();
+  if (index < 0 || index >= images.size())
+  {
+    return std::string();
+  }
+  return images.at(index).toStdString();
+}
+
+ImageDisplayOptions PathTraverser::LoadOptionsForDirectory(const QString &directoryPath, const ImageDisplayOptions &baseOptions) const
+{
+  return FolderOptionsCache::instance().resolve(rootPath, directoryPath, baseOptions);
 }
 
 RecursivePathTraverser::RecursivePathTraverser(const std::string path):
-  PathTraverser(path)
+  PathTraverser(path),
+  library(new ImageLibraryView(LibraryRegistry::instance().library(path, true), path, true))
 {}
 
 RecursivePathTraverser::~RecursivePathTraverser() {}
@@ -39,14 +74,27 @@ RecursivePathTraverser::~RecursivePathTraverser() {}
 
 QStringList RecursivePathTraverser::getImages() const
 {
-    QDirIterator it(QString(path.c_str()), getImageFormats(),
-                    QDir::Files, QDirIterator::Subdirectories);
-    QStringList files;
-    while (it.hasNext())
-    {
-       files.append(it.next());
-    }
-    return files;
+  return library->getImages();
+}
+
+quint64 RecursivePathTraverser::getGeneration() const
+{
+  return library->getGeneration();
+}
+
+quint64 RecursivePathTraverser::getIdLayout() const
+{
+  return library->getIdLayout();
+}
+
+int RecursivePathTraverser::getImageCount() const
+{
+  return library->getImageCount();
+}
+
+std::string RecursivePathTraverser::getImageAt(int index) const
+{
+  return library->getImageAt(index);
 }
 
 const std::string RecursivePathTraverser::getImagePath(const std::string image) const
@@ -56,13 +104,14 @@ const std::string RecursivePathTraverser::getImagePath(const std::string image)
 
 ImageDisplayOptions RecursivePathTraverser::UpdateOptionsForImage(const std::string& filename, const ImageDisplayOptions& baseOptions) const
 {
-  QDir d = QFileInfo(filename.c_str()).absoluteDir();
-  return LoadOptionsForDirectory(d.absolutePath().toStdString(), baseOptions);
+  // options.json files from the top of the tree down to the image's folder all apply
+  return LoadOptionsForDirectory(QFileInfo(QString::fromStdString(filename)).absolutePath(), baseOptions);
 }
 
 DefaultPathTraverser::DefaultPathTraverser(const std::string path):
   PathTraverser(path),
-  directory(path.c_str())
+  directory(path.c_str()),
+  library(new ImageLibraryView(LibraryRegistry::instance().library(path, false), path, false))
 {}
 
 DefaultPathTraverser::~DefaultPathTraverser() {}
@@ -70,7 +119,28 @@ DefaultPathTraverser::~DefaultPathTraverser() {}
 
 QStringList DefaultPathTraverser::getImages() const
 {
-  return directory.entryList(getImageFormats(), QDir::Files);
+  // absolute paths, which getImagePath passes through unchanged
+  return library->getImages();
+}
+
+quint64 DefaultPathTraverser::getGeneration() const
+{
+  return library->getGeneration();
+}
+
+quint64 DefaultPathTraverser::getIdLayout() const
+{
+  return library->getIdLayout();
+}
+
+int DefaultPathTraverser::getImageCount() const
+{
+  return library->getImageCount();
+}
+
+std::string DefaultPathTraverser::getImageAt(int index) const
+{
+  return library->getImageAt(index);
 }
 
 const std::string DefaultPathTraverser::getImagePath(const std::string image) const
@@ -81,11 +151,11 @@ const std::string DefaultPathTraverser::getImagePath(const std::string image) co
 ImageDisplayOptions DefaultPathTraverser::UpdateOptionsForImage(const std::string& filename, const ImageDisplayOptions& baseOptions) const
 {
   Q_UNUSED(filename);
-  return LoadOptionsForDirectory(directory.absolutePath().toStdString(), baseOptions);
+  return LoadOptionsForDirectory(rootPath, baseOptions);
 }
 
 ImageListPathTraverser::ImageListPathTraverser(const std::string &imageListString):
-  PathTraverser("")
+  PathTraverser(imageListString)
 {
   QString str = QString(imageListString.c_str());
   imageList = str.split(QLatin1Char(','));
@@ -112,3 +182,54 @@ ImageDisplayOptions ImageListPathTraverser::UpdateOptionsForImage(const std::str
   return baseOptions;
 }
 
+ImageListFilePathTraverser::ImageListFilePathTraverser(const std::string &listPath):
+  PathTraverser(listPath),
+  list(LibraryRegistry::instance().listFile(listPath))
+{}
+
+ImageListFilePathTraverser::~ImageListFilePathTraverser() {}
+
+QStringList ImageListFilePathTraverser::getImages() const
+{
+  // materialises the whole list, the selectors use getImageCount()/getImageAt() instead
+  QStringList images;
+  const int count = list->getImageCount();
+  images.reserve(count);
+  for (int i = 0; i < count; ++i)
+  {
+    images.append(QString::fromStdString(list->getImageAt(i)));
+  }
+  return images;
+}
+
+quint64 ImageListFilePathTraverser::getGeneration() const
+{
+  return list->getGeneration();
+}
+
+quint64 ImageListFilePathTraverser::getIdLayout() const
+{
+  return list->getLayout();
+}
+
+int ImageListFilePathTraverser::getImageCount() const
+{
+  return list->getImageCount();
+}
+
+std::string ImageListFilePathTraverser::getImageAt(int index) const
+{
+  return list->getImageAt(index);
+}
+
+const std::string ImageListFilePathTraverser::getImagePath(const std::string image) const
+{
+  return image;
+}
+
+ImageDisplayOptions ImageListFilePathTraverser::UpdateOptionsForImage(const std::string& filename, const ImageDisplayOptions& baseOptions) const
+{
+  // no per file options modification supported
+  Q_UNUSED(filename);
+  return baseOptions;
+}
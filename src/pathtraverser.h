@@ -2,10 +2,14 @@
 #define PATHTRAVERSER_H
 
 #include <iostream>
+#include <memory>
 #include <QDir>
 #include <QStringList>
 #include "imageselector.h"
 
+class ImageLibraryView;
+class ImageListFile;
+
 static const QStringList supportedFormats={"jpg","jpeg","png","tif","tiff"};
 
 class MainWindow;
@@ -15,13 +19,21 @@ class PathTraverser
     PathTraverser(const std::string path);
     virtual ~PathTraverser();
     virtual QStringList getImages() const = 0;
+    virtual quint64 getGeneration() const; // changes whenever getImages() would return something different
+    virtual quint64 getIdLayout() const; // changes when existing indexes may name other images, otherwise new images only get new indexes
+    // indexed access, so selectors don't need every image as a string; defaults go through getImages().
+    // Indexes may have gaps, getImageAt() returns an empty path for ones that are no longer an image
+    virtual int getImageCount() const;
+    virtual std::string getImageAt(int index) const;
     virtual const std::string getImagePath(const std::string image) const = 0;
     virtual ImageDisplayOptions UpdateOptionsForImage(const std::string& filename, const ImageDisplayOptions& baseOptions) const = 0;
+    static QStringList getImageFormats();
+    const std::string &getPath() const; // what the images come from, a folder, a list file or the list itself
 
   protected:
     const std::string path;
-    QStringList getImageFormats() const;
-    ImageDisplayOptions LoadOptionsForDirectory(const std::string &directoryPath, const ImageDisplayOptions &baseOptions) const;
+    const QString rootPath; // absolute, where inherited folder options start from
+    ImageDisplayOptions LoadOptionsForDirectory(const QString &directoryPath, const ImageDisplayOptions &baseOptions) const;
 };
 
 class RecursivePathTraverser : public PathTraverser
@@ -30,8 +42,14 @@ class RecursivePathTraverser : public PathTraverser
     RecursivePathTraverser(const std::string path);
     virtual ~RecursivePathTraverser();
     QStringList getImages() const;
+    virtual quint64 getGeneration() const;
+    virtual quint64 getIdLayout() const;
+    virtual int getImageCount() const;
+    virtual std::string getImageAt(int index) const;
     virtual const std::string getImagePath(const std::string image) const;
     virtual ImageDisplayOptions UpdateOptionsForImage(const std::string& filename, const ImageDisplayOptions& baseOptions) const;
+  private:
+    std::shared_ptr<ImageLibraryView> library;
 };
 
 class DefaultPathTraverser : public PathTraverser
@@ -40,10 +58,15 @@ class DefaultPathTraverser : public PathTraverser
     DefaultPathTraverser(const std::string path);
     virtual ~DefaultPathTraverser();
     QStringList getImages() const;
+    virtual quint64 getGeneration() const;
+    virtual quint64 getIdLayout() const;
+    virtual int getImageCount() const;
+    virtual std::string getImageAt(int index) const;
     virtual const std::string getImagePath(const std::string image) const;
     virtual ImageDisplayOptions UpdateOptionsForImage(const std::string& filename, const ImageDisplayOptions& baseOptions) const;
   private:
     QDir directory;
+    std::shared_ptr<ImageLibraryView> library;
 };
 
 class ImageListPathTraverser : public PathTraverser
@@ -57,4 +80,20 @@ class ImageListPathTraverser : public PathTraverser
   private:
     QStringList imageList;
 };
+
+class ImageListFilePathTraverser : public PathTraverser
+{
+  public:
+    ImageListFilePathTraverser(const std::string &listPath);
+    virtual ~ImageListFilePathTraverser();
+    QStringList getImages() const;
+    virtual quint64 getGeneration() const;
+    virtual quint64 getIdLayout() const;
+    virtual int getImageCount() const;
+    virtual std::string getImageAt(int index) const;
+    virtual const std::string getImagePath(const std::string image) const;
+    virtual ImageDisplayOptions UpdateOptionsForImage(const std::string& filename, const ImageDisplayOptions& options) const;
+  private:
+    std::shared_ptr<ImageListFile> list;
+};
 #endif // PATHTRAVERSER_H
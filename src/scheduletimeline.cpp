@@ -0,0 +1,81 @@
+#include "scheduletimeline.h"
+#include <algorithm>
+
+static const int msecsPerDay = 24 * 60 * 60 * 1000;
+
+void ScheduleTimeline::build(const QVector<QVector<DisplayTimeWindow>> &windows, const QVector<bool> &exclusive)
+{
+  std::vector<int> times;
+  times.push_back(0);
+  for (const auto &entryWindows : windows)
+  {
+    for (const auto &window : entryWindows)
+    {
+      times.push_back(window.startDisplay.msecsSinceStartOfDay());
+      times.push_back(window.endDisplay.msecsSinceStartOfDay());
+    }
+  }
+  std::sort(times.begin(), times.end());
+  times.erase(std::unique(times.begin(), times.end()), times.end());
+
+  boundaries.clear();
+  segments.clear();
+  for (size_t i = 0; i < times.size(); ++i)
+  {
+    // nothing starts or ends inside a segment, so an entry is in for all of it or none of it
+    const int start = times[i];
+    const int end = i + 1 < times.size() ? times[i + 1] : msecsPerDay;
+    Segment segment;
+    for (int entry = 0; entry < windows.count(); ++entry)
+    {
+      bool inside = windows[entry].isEmpty();
+      for (const auto &window : windows[entry])
+      {
+        inside = inside || (window.startDisplay.msecsSinceStartOfDay() <= start && end <= window.endDisplay.msecsSinceStartOfDay());
+      }
+      if (!inside)
+        continue;
+      segment.active.append(entry);
+      if (segment.exclusive < 0 && exclusive.value(entry))
+        segment.exclusive = entry;
+    }
+    // only keep the points where something actually changes
+    if (!segments.empty() && segments.back() == segment)
+      continue;
+    boundaries.push_back(start);
+    segments.push_back(segment);
+  }
+}
+
+int ScheduleTimeline::segmentIndex(const QTime &time) const
+{
+  const int msecs = time.msecsSinceStartOfDay();
+  return (int)(std::upper_bound(boundaries.begin(), boundaries.end(), msecs) - boundaries.begin()) - 1;
+}
+
+const ScheduleTimeline::Segment &ScheduleTimeline::segmentAt(const QTime &time) const
+{
+  static const Segment empty;
+  if (segments.empty())
+  {
+    return empty;
+  }
+  return segments[std::max(0, segmentIndex(time))];
+}
+
+qint64 ScheduleTimeline::msecsToNextChange(const QTime &time) const
+{
+  if (segments.size() < 2)
+  {
+    return -1;
+  }
+  const int msecs = time.msecsSinceStartOfDay();
+  const size_t index = (size_t)std::max(0, segmentIndex(time));
+  if (index + 1 < boundaries.size())
+  {
+    return boundaries[index + 1] - msecs;
+  }
+  // the last segment runs to midnight, and on into the first one if that is the same
+  const qint64 untilMidnight = msecsPerDay - msecs;
+  return segments.back() == segments.front() ? untilMidnight + boundaries[1] : untilMidnight;
+}
@@ -0,0 +1,39 @@
+#ifndef SCHEDULETIMELINE_H
+#define SCHEDULETIMELINE_H
+
+#include <QTime>
+#include <QVector>
+#include <vector>
+#include "imagestructs.h"
+
+// the scheduler's time windows compiled into a day split at every point where the set of
+// entries allowed to show images changes, so finding what applies at a time is a binary
+// search and the next change is known ahead of time
+class ScheduleTimeline
+{
+public:
+    struct Segment
+    {
+        QVector<int> active; // entries inside one of their windows, in schedule order
+        int exclusive = -1; // first active exclusive entry, it alone is shown
+
+        bool operator==(const Segment &b) const
+        {
+            return exclusive == b.exclusive && active == b.active;
+        }
+    };
+
+    // one list of windows and an exclusive flag per entry, an entry without windows is always active
+    void build(const QVector<QVector<DisplayTimeWindow>> &windows, const QVector<bool> &exclusive);
+    const Segment &segmentAt(const QTime &time) const;
+    // how long until a different segment applies, -1 if the schedule never changes
+    qint64 msecsToNextChange(const QTime &time) const;
+
+private:
+    int segmentIndex(const QTime &time) const;
+
+    std::vector<int> boundaries; // msecs since midnight each segment starts at, the first is always 0
+    std::vector<Segment> segments;
+};
+
+#endif // SCHEDULETIMELINE_H
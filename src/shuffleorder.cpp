@@ -0,0 +1,148 @@
+#include "shuffleorder.h"
+#include "logger.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+
+static const char stateMagic[4] = {'S','L','S','H'};
+static const quint32 stateVersion = 1;
+static const int feistelRounds = 4;
+
+struct ShuffleState
+{
+    char magic[4];
+    quint32 version;
+    quint64 seed;
+    quint64 epoch;
+    quint32 epochSize;
+    quint32 cursor;
+};
+
+// splitmix64, a cheap mixer that is plenty for picture order
+static quint64 mix(quint64 x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+ShuffleOrder::ShuffleOrder(const std::string &sourceKey)
+{
+  QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation));
+  cacheDir.mkpath("slide/shuffle");
+  const QByteArray name = QCryptographicHash::hash(QByteArray(sourceKey.data(), (int)sourceKey.size()), QCryptographicHash::Sha1).toHex();
+  statePath = cacheDir.filePath("slide/shuffle/" + QString::fromLatin1(name));
+  load();
+}
+
+void ShuffleOrder::setupPermutation()
+{
+  // the smallest even number of bits covering every index, split in two halves
+  int bits = 2;
+  while (bits < 64 && (1ULL << bits) < epochSize)
+    bits += 2;
+  halfBits = bits / 2;
+  for (int round = 0; round < feistelRounds; ++round)
+  {
+    roundKeys[round] = mix(seed ^ mix(epoch * feistelRounds + round));
+  }
+}
+
+quint32 ShuffleOrder::permute(quint32 index) const
+{
+  const quint64 mask = (1ULL << halfBits) - 1;
+  quint64 value = index;
+  // a Feistel network permutes the whole power of two range, walking the cycle until we land
+  // back inside [0, epochSize) keeps it a permutation of just the ids; that's under 4 steps on average
+  do
+  {
+    quint64 left = value >> halfBits;
+    quint64 right = value & mask;
+    for (int round = 0; round < feistelRounds; ++round)
+    {
+      const quint64 next = left ^ (mix(right ^ roundKeys[round]) & mask);
+      left = right;
+      right = next;
+    }
+    value = (left << halfBits) | right;
+  }
+  while (value >= epochSize);
+  return (quint32)value;
+}
+
+void ShuffleOrder::startEpoch(quint32 imageCount)
+{
+  ++epoch;
+  epochSize = imageCount;
+  cursor = 0;
+  setupPermutation();
+  Log("Shuffling ", imageCount, " images, pass ", epoch);
+}
+
+quint32 ShuffleOrder::next(quint32 imageCount)
+{
+  if (cursor >= epochSize)
+  {
+    startEpoch(imageCount);
+  }
+  return permute(cursor++);
+}
+
+void ShuffleOrder::load()
+{
+  QFile file(statePath);
+  ShuffleState state;
+  if (file.open(QIODevice::ReadOnly) && file.read(reinterpret_cast<char*>(&state), sizeof(state)) == sizeof(state) &&
+      memcmp(state.magic, stateMagic, sizeof(stateMagic)) == 0 && state.version == stateVersion && state.cursor <= state.epochSize)
+  {
+    seed = state.seed;
+    epoch = state.epoch;
+    epochSize = state.epochSize;
+    cursor = state.cursor;
+    Log("Resuming shuffle pass ", epoch, " at ", cursor, " of ", epochSize);
+  }
+  else
+  {
+    std::random_device rd;
+    seed = ((quint64)rd() << 32) ^ rd();
+  }
+  setupPermutation();
+}
+
+void ShuffleOrder::save() const
+{
+  ShuffleState state;
+  memcpy(state.magic, stateMagic, sizeof(stateMagic));
+  state.version = stateVersion;
+  state.seed = seed;
+  state.epoch = epoch;
+  state.epochSize = epochSize;
+  state.cursor = cursor;
+
+  // write next to the state and rename over it, so a power cut leaves the old or the new one.
+  // The data has to be on disk before the rename is, or the rename can survive a power cut
+  // that the data doesn't and leave an empty file
+  const QString tempPath = statePath + "." + QString::number(QCoreApplication::applicationPid());
+  QFile tempFile(tempPath);
+  if (!tempFile.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+      tempFile.write(reinterpret_cast<const char*>(&state), sizeof(state)) != sizeof(state) ||
+      !tempFile.flush() || ::fsync(tempFile.handle()) != 0)
+  {
+    Log("Failed to write shuffle state: ", tempPath.toStdString());
+    tempFile.remove();
+    return;
+  }
+  tempFile.close();
+  if (::rename(QFile::encodeName(tempPath).constData(), QFile::encodeName(statePath).constData()) != 0)
+  {
+    Log("Failed to replace shuffle state: ", statePath.toStdString());
+    tempFile.remove();
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef SHUFFLEORDER_H
+#define SHUFFLEORDER_H
+
+#include <QString>
+#include <QtGlobal>
+#include <string>
+
+// a shuffled pass over image ids that needs no list: the i-th image of an epoch is the i-th
+// element of a seeded pseudo-random permutation of the ids, computed with a small Feistel
+// network and cycle walking. Seed, epoch and cursor are kept in ~/.cache/slide/shuffle per
+// source, so a restart carries on where it left off. Images added during an epoch join the
+// next one.
+class ShuffleOrder
+{
+public:
+    ShuffleOrder(const std::string &sourceKey);
+    quint32 next(quint32 imageCount);
+    quint32 remaining() const { return epochSize - cursor; }
+    void save() const; // once per pick rather than per step, skipped images don't need a write each
+
+private:
+    void startEpoch(quint32 imageCount);
+    void setupPermutation();
+    quint32 permute(quint32 index) const;
+    void load();
+
+    QString statePath;
+    quint64 seed = 0;
+    quint64 epoch = 0;
+    quint64 roundKeys[4];
+    int halfBits = 1;
+    quint32 epochSize = 0;
+    quint32 cursor = 0;
+};
+
+#endif // SHUFFLEORDER_H
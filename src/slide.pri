@@ -0,0 +1,71 @@
+# everything but main(), shared by the app and the benchmarks in bench/
+
+INCLUDEPATH += $$PWD
+
+mac: INCLUDEPATH += $$system(brew --prefix libexif)/include/
+mac: QMAKE_LFLAGS += -L$$system(brew --prefix libexif)/lib
+
+SOURCES += \
+        $$PWD/mainwindow.cpp \
+        $$PWD/imageswitcher.cpp \
+        $$PWD/pathtraverser.cpp \
+        $$PWD/overlay.cpp \
+        $$PWD/imageselector.cpp \
+        $$PWD/shuffleorder.cpp \
+        $$PWD/scheduletimeline.cpp \
+        $$PWD/appconfig.cpp \
+        $$PWD/configwatcher.cpp \
+        $$PWD/headlessrunner.cpp \
+        $$PWD/metrics.cpp \
+        $$PWD/metricswriter.cpp \
+        $$PWD/trace.cpp \
+        $$PWD/folderoptionscache.cpp \
+        $$PWD/imagestructs.cpp \
+        $$PWD/imagerenderer.cpp \
+        $$PWD/imageprefetcher.cpp \
+        $$PWD/imagefilters.cpp \
+        $$PWD/imagedecoder.cpp \
+        $$PWD/slideview.cpp \
+        $$PWD/imagemetadata.cpp \
+        $$PWD/metadataindex.cpp \
+        $$PWD/pathstore.cpp \
+        $$PWD/imagelibrary.cpp \
+        $$PWD/imagelistfile.cpp \
+        $$PWD/libraryregistry.cpp \
+        $$PWD/framecache.cpp \
+        $$PWD/logger.cpp
+
+HEADERS += \
+        $$PWD/mainwindow.h \
+        $$PWD/imageselector.h \
+        $$PWD/shuffleorder.h \
+        $$PWD/scheduletimeline.h \
+        $$PWD/pathtraverser.h \
+        $$PWD/overlay.h \
+        $$PWD/imageswitcher.h \
+        $$PWD/imagestructs.h \
+        $$PWD/appconfig.h \
+        $$PWD/configwatcher.h \
+        $$PWD/headlessrunner.h \
+        $$PWD/metrics.h \
+        $$PWD/metricswriter.h \
+        $$PWD/trace.h \
+        $$PWD/folderoptionscache.h \
+        $$PWD/imagerenderer.h \
+        $$PWD/imageprefetcher.h \
+        $$PWD/imagefilters.h \
+        $$PWD/imagedecoder.h \
+        $$PWD/slideview.h \
+        $$PWD/imagemetadata.h \
+        $$PWD/metadataindex.h \
+        $$PWD/pathstore.h \
+        $$PWD/imagelibrary.h \
+        $$PWD/imagelistfile.h \
+        $$PWD/libraryregistry.h \
+        $$PWD/framecache.h \
+        $$PWD/logger.h
+
+FORMS += \
+        $$PWD/mainwindow.ui
+
+unix|win32: LIBS += -lexif -lpng -ltiff
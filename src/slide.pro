@@ -25,36 +25,11 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-mac: INCLUDEPATH += $$system(brew --prefix libexif)/include/
-mac: QMAKE_LFLAGS += -L$$system(brew --prefix libexif)/lib
-
-
-
 SOURCES += \
-        main.cpp \
-        mainwindow.cpp \
-        imageswitcher.cpp \
-        pathtraverser.cpp \
-        overlay.cpp \
-        imageselector.cpp \
-        appconfig.cpp \
-        imagestructs.cpp \
-        logger.cpp
-
-HEADERS += \
-        mainwindow.h \
-        imageselector.h \
-        pathtraverser.h \
-        overlay.h \
-        imageswitcher.h \
-        imagestructs.h \
-        appconfig.h \
-        logger.h
-
-FORMS += \
-        mainwindow.ui
+        main.cpp
+
+include(slide.pri)
 
 target.path = /usr/local/bin/
 INSTALLS += target
 
-unix|win32: LIBS += -lexif
@@ -0,0 +1,251 @@
+#include "slideview.h"
+#include "imagefilters.h"
+#include "metrics.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QTime>
+#include <algorithm>
+#include <utility>
+
+SlideView::SlideView(QWidget *parent) :
+    QWidget(parent)
+{
+  // every pixel is painted by paintEvent, skip clearing the background first
+  setAttribute(Qt::WA_OpaquePaintEvent);
+  transitionTimer.setTimerType(Qt::PreciseTimer);
+  connect(&transitionTimer, SIGNAL(timeout()), this, SLOT(transitionStep()));
+  overlayTimer.setSingleShot(true);
+  connect(&overlayTimer, SIGNAL(timeout()), this, SLOT(overlayTick()));
+}
+
+void SlideView::setTransitionTime(unsigned int transitionMsecIn)
+{
+  transitionMsec = transitionMsecIn;
+}
+
+void SlideView::setTransitionFps(unsigned int fps)
+{
+  transitionFps = std::max(1u, fps);
+  transitionTimer.setInterval(1000 / transitionFps);
+}
+
+void SlideView::setFrame(const QImage &frameIn)
+{
+  QImage frame = frameIn;
+  if (frame.format() != QImage::Format_ARGB32_Premultiplied && frame.format() != QImage::Format_RGB32)
+  {
+    frame = frame.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  }
+  message.clear();
+
+  const QImage &onScreen = transitioning ? blendFrame : currentFrame;
+  if (transitionMsec == 0 || frame.isNull() || onScreen.isNull() || onScreen.size() != frame.size())
+  {
+    stopTransition();
+    currentFrame = frame;
+    update();
+    return;
+  }
+
+  // fade from whatever is on screen now, which may be a half finished transition
+  if (transitioning)
+  {
+    std::swap(previousFrame, blendFrame);
+  }
+  else
+  {
+    previousFrame = currentFrame;
+  }
+  currentFrame = frame;
+  if (blendFrame.size() != frame.size() || blendFrame.format() != QImage::Format_ARGB32_Premultiplied)
+  {
+    blendFrame = QImage(frame.size(), QImage::Format_ARGB32_Premultiplied);
+  }
+  BlendImages(previousFrame, currentFrame, blendFrame, 0);
+  transitioning = true;
+  transitionClock.start();
+  transitionTimer.start(1000 / transitionFps);
+  update();
+}
+
+void SlideView::setOverlay(Overlay *overlayIn)
+{
+  overlay = overlayIn;
+  for (int corner = 0; corner < OverlayCorner_Count; ++corner)
+  {
+    overlayTexts[corner] = QStaticText();
+    overlayTexts[corner].setTextFormat(Qt::PlainText);
+  }
+  if (overlay != nullptr)
+  {
+    const int fontsizes[OverlayCorner_Count] = {overlay->getFontsizeTopLeft(), overlay->getFontsizeTopRight(),
+                                                overlay->getFontsizeBottomLeft(), overlay->getFontsizeBottomRight()};
+    for (int corner = 0; corner < OverlayCorner_Count; ++corner)
+    {
+      overlayFonts[corner] = QFont("Sans", fontsizes[corner], QFont::Bold);
+    }
+  }
+  refreshOverlay();
+}
+
+void SlideView::setOverlayColor(const QColor &color)
+{
+  overlayColor = color;
+  update();
+}
+
+void SlideView::setOverlayImage(const ImageDetails &imageDetails)
+{
+  overlayImage = imageDetails;
+  overlayImage.image = QImage(); // only the details are needed, don't hold on to pixels
+  refreshOverlay();
+}
+
+QRect SlideView::overlayTextRect(int corner) const
+{
+  if (overlay == nullptr || overlayTexts[corner].text().isEmpty())
+  {
+    return QRect();
+  }
+  const int margins[OverlayCorner_Count] = {overlay->getMarginTopLeft(), overlay->getMarginTopRight(),
+                                            overlay->getMarginBottomLeft(), overlay->getMarginBottomRight()};
+  const int margin = margins[corner];
+  const QSize textSize = overlayTexts[corner].size().toSize();
+  const bool right = corner == OverlayCorner_TopRight || corner == OverlayCorner_BottomRight;
+  const bool bottom = corner == OverlayCorner_BottomLeft || corner == OverlayCorner_BottomRight;
+  const int x = right ? width() - margin - textSize.width() : margin;
+  const int y = bottom ? height() - margin - textSize.height() : margin;
+  return QRect(QPoint(x, y), textSize);
+}
+
+void SlideView::refreshOverlay()
+{
+  overlayTimer.stop();
+  if (overlay == nullptr || overlayImage.filename.empty())
+  {
+    return;
+  }
+
+  StageTimer timer(Metrics::overlay);
+  const QStringList corners = overlay->renderCorners(overlayImage);
+  for (int corner = 0; corner < OverlayCorner_Count && corner < corners.size(); ++corner)
+  {
+    if (overlayTexts[corner].text() == corners[corner])
+    {
+      continue;
+    }
+    // repaint where the old text was and where the new one goes, nothing else
+    update(overlayTextRect(corner));
+    overlayTexts[corner].setText(corners[corner]);
+    overlayTexts[corner].prepare(QTransform(), overlayFonts[corner]);
+    update(overlayTextRect(corner));
+  }
+  scheduleOverlayTick();
+}
+
+void SlideView::scheduleOverlayTick()
+{
+  if (overlay == nullptr || !overlay->hasTimeTokens())
+  {
+    return;
+  }
+  // wake up just after the next second or minute boundary so the clock never lags
+  const QTime now = QTime::currentTime();
+  int msecToBoundary = 1000 - now.msec();
+  if (!overlay->hasSecondsTokens())
+  {
+    msecToBoundary += (59 - now.second()) * 1000;
+  }
+  overlayTimer.start(msecToBoundary + 5);
+}
+
+void SlideView::overlayTick()
+{
+  refreshOverlay();
+}
+
+void SlideView::showMessage(const QString &text)
+{
+  stopTransition();
+  currentFrame = QImage();
+  overlayImage = ImageDetails();
+  overlayTimer.stop();
+  message = text;
+  update();
+}
+
+void SlideView::clear()
+{
+  showMessage(QString());
+}
+
+void SlideView::stopTransition()
+{
+  transitionTimer.stop();
+  transitioning = false;
+  previousFrame = QImage();
+}
+
+void SlideView::transitionStep()
+{
+  const qint64 elapsed = transitionClock.elapsed();
+  if (elapsed >= transitionMsec)
+  {
+    const qint64 duration = transitionClock.nsecsElapsed();
+    Metrics::transition.observe(duration);
+    if (Trace::instance().enabled())
+    {
+      Trace::instance().complete("transition", Trace::instance().now() - duration, duration, Trace::transitionTrack);
+    }
+    stopTransition();
+  }
+  else
+  {
+    TraceSpan span("blend");
+    BlendImages(previousFrame, currentFrame, blendFrame, (int)(elapsed * 128 / transitionMsec));
+  }
+  update();
+}
+
+void SlideView::paintEvent(QPaintEvent *event)
+{
+  TraceSpan span("paint");
+  QPainter painter(this);
+  const QImage &frame = transitioning ? blendFrame : currentFrame;
+  if (frame.isNull())
+  {
+    painter.fillRect(rect(), Qt::black);
+    painter.setPen(Qt::white);
+    painter.drawText(rect(), Qt::AlignCenter, message);
+    return;
+  }
+
+  if (frame.size() != size())
+  {
+    painter.fillRect(rect(), Qt::black);
+  }
+  // frames are opaque, a straight copy is the fastest way onto the backing store.
+  // Only the dirty parts are copied, a clock tick just redraws the text's corner
+  const QPoint origin((width() - frame.width()) / 2, (height() - frame.height()) / 2);
+  painter.setCompositionMode(QPainter::CompositionMode_Source);
+  for (const QRect &rect : event->region())
+  {
+    painter.drawImage(rect, frame, rect.translated(-origin));
+  }
+
+  if (overlay == nullptr || overlayImage.filename.empty())
+  {
+    return;
+  }
+  painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+  painter.setPen(overlayColor);
+  for (int corner = 0; corner < OverlayCorner_Count; ++corner)
+  {
+    const QRect textRect = overlayTextRect(corner);
+    if (textRect.isValid() && event->region().intersects(textRect))
+    {
+      painter.setFont(overlayFonts[corner]);
+      painter.drawStaticText(textRect.topLeft(), overlayTexts[corner]);
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef SLIDEVIEW_H
+#define SLIDEVIEW_H
+
+#include <QWidget>
+#include <QImage>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QColor>
+#include <QFont>
+#include <QStaticText>
+#include "overlay.h"
+
+// paints finished frames straight to the window and crossfades between them in software.
+// The blend target is allocated once per screen size, so an animation step is a single
+// vectorised blend plus a drawImage, with no graphics effect or offscreen pass in between.
+// The overlay text is a separate layer on top of the frame, clock tokens tick on their own
+// timer and only repaint the corners whose text changed.
+class SlideView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit SlideView(QWidget *parent = nullptr);
+    void setFrame(const QImage &frame);
+    void showMessage(const QString &text);
+    void clear();
+    void setTransitionTime(unsigned int transitionMsec);
+    void setTransitionFps(unsigned int fps);
+    void setOverlay(Overlay *overlay);
+    void setOverlayColor(const QColor &color);
+    void setOverlayImage(const ImageDetails &imageDetails);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private slots:
+    void transitionStep();
+    void overlayTick();
+
+private:
+    void stopTransition();
+    void refreshOverlay();
+    void scheduleOverlayTick();
+    QRect overlayTextRect(int corner) const;
+
+    QImage previousFrame;
+    QImage currentFrame;
+    QImage blendFrame; // what is on screen while a transition runs
+    bool transitioning = false;
+    QString message;
+    unsigned int transitionMsec = 1000;
+    unsigned int transitionFps = 30;
+    QTimer transitionTimer;
+    QElapsedTimer transitionClock;
+
+    Overlay *overlay = nullptr; // owned by the main window
+    ImageDetails overlayImage;
+    QColor overlayColor = Qt::white;
+    QFont overlayFonts[OverlayCorner_Count];
+    QStaticText overlayTexts[OverlayCorner_Count];
+    QTimer overlayTimer;
+};
+
+#endif // SLIDEVIEW_H
@@ -0,0 +1,99 @@
+#include "imageselector.h"
+#include "pathtraverser.h"
+#include "logger.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <memory>
+
+class SelectorTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void folderAspectOverridesRandom();
+    void folderAspectOverridesShuffle();
+
+private:
+    QSet<QString> select(std::unique_ptr<ImageSelector> &selector, int selections);
+    QTemporaryDir folder;
+    ImageDisplayOptions landscapeOnly;
+};
+
+void SelectorTest::initTestCase()
+{
+  // landscape images at the top, a folder of portrait ones whose options.json asks for portrait
+  QVERIFY(folder.isValid());
+  QDir root(folder.path());
+  QVERIFY(root.mkpath("tall"));
+  QVERIFY(QImage(64, 48, QImage::Format_RGB32).save(root.filePath("wide1.jpg")));
+  QVERIFY(QImage(64, 48, QImage::Format_RGB32).save(root.filePath("wide2.jpg")));
+  QVERIFY(QImage(48, 64, QImage::Format_RGB32).save(root.filePath("tall/tall1.jpg")));
+  QVERIFY(QImage(48, 64, QImage::Format_RGB32).save(root.filePath("tall/tall2.jpg")));
+  QFile options(root.filePath("tall/options.json"));
+  QVERIFY(options.open(QIODevice::WriteOnly));
+  options.write("{ \"aspect\": \"p\" }");
+  options.close();
+
+  landscapeOnly.onlyAspect = ImageAspectScreenFilter_Landscape;
+}
+
+QSet<QString> SelectorTest::select(std::unique_ptr<ImageSelector> &selector, int selections)
+{
+  QSet<QString> selected;
+  for (int i = 0; i < selections; ++i)
+  {
+    const ImageDetails details = selector->getNextImage(landscapeOnly);
+    if (!details.filename.empty())
+    {
+      selected.insert(QFileInfo(QString::fromStdString(details.filename)).fileName());
+    }
+  }
+  return selected;
+}
+
+void SelectorTest::folderAspectOverridesRandom()
+{
+  std::unique_ptr<PathTraverser> traverser(new RecursivePathTraverser(folder.path().toStdString()));
+  std::unique_ptr<ImageSelector> selector(new RandomImageSelector(traverser));
+  // the first selections classify every image, the portrait folder has to keep coming up after that
+  select(selector, 100);
+  const QSet<QString> selected = select(selector, 200);
+  QCOMPARE(selected, QSet<QString>({"wide1.jpg", "wide2.jpg", "tall1.jpg", "tall2.jpg"}));
+}
+
+void SelectorTest::folderAspectOverridesShuffle()
+{
+  std::unique_ptr<PathTraverser> traverser(new RecursivePathTraverser(folder.path().toStdString()));
+  std::unique_ptr<ImageSelector> selector(new ShuffleImageSelector(traverser, "folder aspect test"));
+  // the first pass puts every image in the metadata index, the second can skip by it
+  select(selector, 4);
+  const QSet<QString> selected = select(selector, 4);
+  QCOMPARE(selected, QSet<QString>({"wide1.jpg", "wide2.jpg", "tall1.jpg", "tall2.jpg"}));
+}
+
+int main(int argc, char *argv[])
+{
+  if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+  {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  // keep the metadata index and shuffle state away from the real ones
+  QTemporaryDir cache;
+  qputenv("XDG_CACHE_HOME", QFile::encodeName(cache.path()));
+
+  QApplication a(argc, argv);
+  SetupLogger(false);
+  SelectorTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "selectortest.moc"
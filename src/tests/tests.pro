@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Tests for behaviour the slideshow only shows over many
+# selections, run against generated folders.
+#
+#-------------------------------------------------
+
+QT       += core gui testlib
+CONFIG += qt console
+CONFIG += c++1z
+CONFIG -= app_bundle
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = slide-tests
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        selectortest.cpp
+
+include(../slide.pri)
@@ -0,0 +1,134 @@
+#include "trace.h"
+#include "logger.h"
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+
+Trace &Trace::instance()
+{
+  static Trace trace;
+  return trace;
+}
+
+Trace::~Trace()
+{
+  finish();
+}
+
+int Trace::currentTrack()
+{
+  // small stable numbers read better in the viewer than thread ids, the thread that starts
+  // the trace (the GUI thread) is 1
+  static std::atomic<int> nextTrack{1};
+  thread_local int track = nextTrack.fetch_add(1);
+  return track;
+}
+
+void Trace::start(const std::string &pathIn, unsigned int maxSwitchesIn)
+{
+  finish();
+  std::lock_guard<std::mutex> lock(mutex);
+  path = QString::fromStdString(pathIn);
+  maxSwitches = maxSwitchesIn;
+  events.clear();
+  events.reserve(4096);
+  dropped = 0;
+  switches = 0;
+  currentTrack();
+  clock.start();
+  active.store(true);
+  Log("Tracing to ", pathIn);
+}
+
+void Trace::complete(const char *name, qint64 startNsecs, qint64 durationNsecs, int track)
+{
+  const int eventTrack = track >= 0 ? track : currentTrack();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!active.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  if (events.size() >= maxEvents)
+  {
+    ++dropped;
+    return;
+  }
+  events.push_back({name, startNsecs, durationNsecs, eventTrack});
+}
+
+void Trace::switchStarting()
+{
+  if (!enabled())
+  {
+    return;
+  }
+  bool done = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = maxSwitches > 0 && ++switches > maxSwitches;
+  }
+  if (done)
+  {
+    stopRecording();
+  }
+}
+
+void Trace::stopRecording()
+{
+  std::vector<Event> recorded;
+  quint64 droppedEvents = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!active.exchange(false))
+    {
+      return;
+    }
+    recorded.swap(events);
+    droppedEvents = dropped;
+  }
+  // formatting and writing a few MB would stall a frame, do it on the side
+  writer = std::thread(&Trace::write, this, std::move(recorded), droppedEvents);
+}
+
+void Trace::finish()
+{
+  stopRecording();
+  if (writer.joinable())
+  {
+    writer.join();
+  }
+}
+
+void Trace::write(std::vector<Event> recorded, quint64 droppedEvents) const
+{
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+  {
+    Log("Unable to write trace ", path.toStdString());
+    return;
+  }
+  QTextStream out(&file);
+  out.setRealNumberNotation(QTextStream::FixedNotation);
+  out.setRealNumberPrecision(3);
+  out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << droppedEvents << "},\"traceEvents\":[\n";
+
+  int maxTrack = 1;
+  for (const Event &event : recorded)
+  {
+    maxTrack = std::max(maxTrack, event.track);
+  }
+  out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << (int)transitionTrack << ",\"args\":{\"name\":\"transition\"}},\n";
+  out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"gui\"}}";
+  for (int track = 2; track <= maxTrack; ++track)
+  {
+    out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":\"worker " << track - 1 << "\"}}";
+  }
+  for (const Event &event : recorded)
+  {
+    out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"slide\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+        << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+  }
+  out << "\n]}\n";
+  out.flush();
+  Log("Wrote ", recorded.size(), " trace events to ", path.toStdString());
+}
@@ -0,0 +1,80 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// records spans as Chrome trace events ("X" complete events) for chrome://tracing or
+// Perfetto. Events are kept in memory and written out on a thread of their own once the
+// requested number of image switches has been recorded, or at exit. When tracing is off
+// a span costs one relaxed atomic load.
+class Trace
+{
+public:
+    static Trace &instance();
+    ~Trace();
+
+    // maxSwitches of 0 keeps recording until finish()
+    void start(const std::string &path, unsigned int maxSwitches);
+    void finish();
+    bool enabled() const { return active.load(std::memory_order_relaxed); }
+
+    qint64 now() const { return clock.nsecsElapsed(); }
+    // name must outlive the trace, a literal or a stage name
+    void complete(const char *name, qint64 startNsecs, qint64 durationNsecs, int track = -1);
+    // the first maxSwitches switches are recorded whole, including whatever they leave running
+    // on other threads, recording stops when the next one starts
+    void switchStarting();
+
+    static const int transitionTrack = 0; // animations overlap everything on the GUI thread, so they get their own row
+
+private:
+    struct Event
+    {
+        const char *name;
+        qint64 start;
+        qint64 duration;
+        int track;
+    };
+
+    Trace() {}
+    void stopRecording();
+    void write(std::vector<Event> events, quint64 dropped) const;
+    static int currentTrack();
+
+    const size_t maxEvents = 256 * 1024; // 8MB in memory, bounds a trace left running on a Pi
+    std::atomic<bool> active{false};
+    QString path;
+    QElapsedTimer clock;
+    unsigned int maxSwitches = 0;
+    std::mutex mutex;
+    std::vector<Event> events;
+    quint64 dropped = 0;
+    unsigned int switches = 0;
+    std::thread writer;
+};
+
+// traces the enclosing scope
+class TraceSpan
+{
+public:
+    TraceSpan(const char *name): name(name), start(Trace::instance().enabled() ? Trace::instance().now() : -1) {}
+    ~TraceSpan()
+    {
+      if (start >= 0 && Trace::instance().enabled())
+      {
+        Trace::instance().complete(name, start, Trace::instance().now() - start);
+      }
+    }
+private:
+    const char *name;
+    const qint64 start;
+};
+
+#endif // TRACE_H